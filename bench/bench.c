@@ -0,0 +1,365 @@
+#include <errno.h>          // errno
+#include <fcntl.h>          // open() etc.
+#include <stdio.h>          // printf() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strstr() etc.
+#include <sys/stat.h>       // fstat() etc.
+#include <time.h>           // clock_gettime()
+#include <unistd.h>         // unlink() etc.
+
+#include "cat_manager.h"    // SAME
+#include "compare.h"        // first_difference()
+#include "entry_manager.h"  // copy_file() etc.
+#include "hashindex.h"      // hash_index_create() etc.
+#include "info.h"           // GlobalInfo
+#include "linktable.h"      // link_table_create() etc.
+#include "policy.h"         // policy_entries_verdict() etc.
+#include "stats.h"          // stats_init() etc.
+#include "utils.h"          // concatinate() etc.
+
+// Microbenchmarks of the routines that a run of cmpcat spends its time in. Every benchmark repeats its
+// routine until it ran for at least BENCH_TIME seconds, and prints a line with its name, its parameter
+// (the size of a file or the number of entries, '-' if it has none), the operations per second and, for
+// the routines that move file contents, the gigabytes per second. Every line keeps the same columns, so
+// the output of two builds can be diffed. Only the benchmarks whose name contains the first argument run
+// NOTE: Files are created in $TMPDIR (or /tmp) and are read from the page cache. The benchmarks measure
+// the CPU cost of the routines, not the speed of the storage
+
+// Least seconds that every benchmark runs for
+#define BENCH_TIME 0.25
+
+GlobalInfo *info; // Global info is shared with the source files of cmpcat
+
+static char *filter = NULL;     // Part of the names of the benchmarks to run. NULL to run all of them
+static char *workDir;           // Directory of the files of the benchmarks
+
+// A routine that runs given number of operations
+typedef void (*Routine)(void *arg, long ops);
+
+static double now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime()");
+        exit(EXIT_FAILURE);
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run 'routine' until it ran for at least BENCH_TIME seconds and print its line. 'param' is printed as is,
+// or as '-' if it is 0. 'bytes' are the bytes of files that every operation moves, or 0
+static void bench(char *name, long param, Routine routine, void *arg, double bytes) {
+    if (filter != NULL && strstr(name, filter) == NULL) return;
+    // Warm up the caches before timing
+    routine(arg, 1);
+    long ops = 1;
+    double elapsed;
+    while (1) {
+        double start = now();
+        routine(arg, ops);
+        elapsed = now() - start;
+        if (elapsed >= BENCH_TIME) break;
+        // Aim past the least time from the rate measured so far, growing at least twofold
+        long next = (elapsed > 0) ? (long)(ops * BENCH_TIME * 1.2 / elapsed) : 100 * ops;
+        ops = (next < 2 * ops) ? 2 * ops : (next > 100 * ops) ? 100 * ops : next;
+    }
+    double rate = ops / elapsed;
+    char paramText[32] = "-", bandwidth[32] = "-";
+    if (param != 0) snprintf(paramText, sizeof(paramText), "%ld", param);
+    if (bytes > 0) snprintf(bandwidth, sizeof(bandwidth), "%.3f", rate * bytes / 1e9);
+    printf("%-24s %10s %16.1f %10s\n", name, paramText, rate, bandwidth);
+    fflush(stdout);
+}
+
+// Create a file of 'size' bytes of given pattern in the work directory, and return its entry
+static void file_create(char *name, off_t size, unsigned char pattern, EntryInfo *entry) {
+    char *path = concatinate(workDir, name);
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    char buffer[BUFLEN];
+    for (size_t i = 0; i < sizeof(buffer); i++) buffer[i] = (char)(pattern + i * 31);
+    for (off_t offset = 0; offset < size; offset += sizeof(buffer)) {
+        fullwrite(fd, buffer, (size - offset < (off_t)sizeof(buffer)) ? (size_t)(size - offset) : sizeof(buffer));
+    }
+    struct stat myStat;
+    if (fstat(fd, &myStat) == -1) {
+        perror("fstat()");
+        exit(EXIT_FAILURE);
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+
+    entry->relativePath = path;
+    entry->relativeToHier = path;
+    entry->name = path + strlen(workDir);
+    entry->device = myStat.st_dev;
+    entry->inode = myStat.st_ino;
+    entry->links = myStat.st_nlink;
+    entry->size = myStat.st_size;
+    entry->mtime = myStat.st_mtim.tv_sec;
+    entry->mtimeNsec = myStat.st_mtim.tv_nsec;
+    entry->perms = myStat.st_mode;
+    entry->fileType = REGFILE;
+    entry->fromHierarchy = HIER_A;
+}
+
+// Remove the file of an entry that file_create() returned
+static void file_remove(EntryInfo *entry) {
+    if (unlink(entry->relativePath) == -1 && errno != ENOENT) {
+        perror("unlink()");
+        exit(EXIT_FAILURE);
+    }
+    free(entry->relativePath);
+}
+
+typedef struct {
+    char *a;
+    char *b;
+    size_t len;
+} Buffers;
+
+static void run_first_difference(void *arg, long ops) {
+    Buffers *buffers = arg;
+    for (long i = 0; i < ops; i++) {
+        if (first_difference(buffers->a, buffers->b, buffers->len) != buffers->len) abort();
+    }
+}
+
+// The kernel that every comparison of file contents ends in, on memory alone
+static void bench_first_difference(void) {
+    static const size_t sizes[] = {4096, 64 * 1024, 1024 * 1024};
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        Buffers buffers = {malloc(sizes[k]), malloc(sizes[k]), sizes[k]};
+        NULL_CHECK(buffers.a, "malloc");
+        NULL_CHECK(buffers.b, "malloc");
+        for (size_t i = 0; i < sizes[k]; i++) buffers.a[i] = buffers.b[i] = (char)(i * 31);
+        bench("compare/memory", sizes[k], run_first_difference, &buffers, 2.0 * sizes[k]);
+        free(buffers.a);
+        free(buffers.b);
+    }
+}
+
+typedef struct {
+    EntryInfo a;
+    EntryInfo b;
+} FilePair;
+
+static void run_verdict(void *arg, long ops) {
+    FilePair *pair = arg;
+    for (long i = 0; i < ops; i++) {
+        if (policy_entries_verdict(&pair->a, &pair->b) != SAME) abort();
+    }
+}
+
+// The verdict of a pair of same files, which have to be compared in whole (opening, reading and closing both)
+static void bench_verdict(void) {
+    static const off_t sizes[] = {4096, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        FilePair pair;
+        file_create("verdictA", sizes[k], 7, &pair.a);
+        file_create("verdictB", sizes[k], 7, &pair.b);
+        pair.b.fromHierarchy = HIER_B;
+        bench("compare/verdict", sizes[k], run_verdict, &pair, 2.0 * sizes[k]);
+        file_remove(&pair.a);
+        file_remove(&pair.b);
+    }
+}
+
+typedef struct {
+    EntryInfo from;
+    char *to;
+} Copy;
+
+static void run_copy(void *arg, long ops) {
+    Copy *copy = arg;
+    for (long i = 0; i < ops; i++) {
+        if (unlink(copy->to) == -1 && errno != ENOENT) {
+            perror("unlink()");
+            exit(EXIT_FAILURE);
+        }
+        copy_file(&copy->from, copy->to);
+    }
+}
+
+// The copy of a file to the merged hierarchy, through the cheapest method that the filesystem supports
+static void bench_copy(void) {
+    static const off_t sizes[] = {4096, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        Copy copy;
+        file_create("copyFrom", sizes[k], 11, &copy.from);
+        copy.to = concatinate(workDir, "copyTo");
+        bench("merge/copy", sizes[k], run_copy, &copy, (double)sizes[k]);
+        file_remove(&copy.from);
+        if (unlink(copy.to) == -1 && errno != ENOENT) {
+            perror("unlink()");
+            exit(EXIT_FAILURE);
+        }
+        free(copy.to);
+    }
+}
+
+static void run_concatinate(void *arg, long ops) {
+    (void)arg;
+    for (long i = 0; i < ops; i++) free(concatinate("./data/projectDir_A/some/nested/directory", "entry-name.txt"));
+}
+
+static void run_get_absolute_path(void *arg, long ops) {
+    (void)arg;
+    for (long i = 0; i < ops; i++) free(get_absolute_path("/home/user/work/", "../data/./projectDir_A/sub/../"));
+}
+
+static void run_fix_path(void *arg, long ops) {
+    (void)arg;
+    char path[] = "data/projectDir_A";
+    for (long i = 0; i < ops; i++) free(fix_path(path));
+}
+
+// The helpers of utils.c that build paths
+static void bench_paths(void) {
+    bench("path/concatinate", 0, run_concatinate, NULL, 0);
+    bench("path/get_absolute_path", 0, run_get_absolute_path, NULL, 0);
+    bench("path/fix_path", 0, run_fix_path, NULL, 0);
+}
+
+typedef struct {
+    LinkTable *table;
+    long count;         // Files that stay in the table
+    long next;          // Inode of the next file that is inserted and found
+} Links;
+
+static void run_link_insert_find(void *arg, long ops) {
+    Links *links = arg;
+    for (long i = 0; i < ops; i++) {
+        // A file with 2 names leaves the table once its second name is found
+        ino_t inode = links->count + links->next++;
+        link_table_insert(links->table, 1, inode, 2, "./merged/some/hardlinked/file");
+        char *path = link_table_find(links->table, 1, inode);
+        if (path == NULL) abort();
+        free(path);
+    }
+}
+
+static void run_link_find(void *arg, long ops) {
+    Links *links = arg;
+    for (long i = 0; i < ops; i++) {
+        char *path = link_table_find(links->table, 1, (ino_t)(i % links->count));
+        if (path == NULL) abort();
+        free(path);
+    }
+}
+
+// The table of copied hardlinks, holding given number of files whose other names were not seen yet
+static void bench_links(void) {
+    static const long counts[] = {1000, 100000};
+    for (size_t k = 0; k < sizeof(counts) / sizeof(*counts); k++) {
+        Links links = {link_table_create(), counts[k], 0};
+        // So many names that the files never leave the table
+        for (long i = 0; i < counts[k]; i++) link_table_insert(links.table, 1, (ino_t)i, (nlink_t)-1, "./merged/some/hardlinked/file");
+        bench("links/insert-find", counts[k], run_link_insert_find, &links, 0);
+        bench("links/find", counts[k], run_link_find, &links, 0);
+        link_table_destroy(links.table);
+    }
+}
+
+typedef struct {
+    unsigned long *hashes;
+    char *strings;
+    size_t *keys;
+    char **lookups;     // Copies of the keys, as the paths of the other catalog would be
+    int count;
+    HashIndex *index;
+} Level;
+
+static void run_level_build(void *arg, long ops) {
+    Level *level = arg;
+    for (long i = 0; i < ops; i++) hash_index_destroy(hash_index_create(level->hashes, level->strings, level->keys, 0, level->count));
+}
+
+static void run_level_find(void *arg, long ops) {
+    Level *level = arg;
+    for (long i = 0; i < ops; i++) {
+        int k = (int)(i % level->count);
+        if (hash_index_find(level->index, level->hashes[k], level->lookups[k]) != k) abort();
+    }
+}
+
+// The index of a level of a catalog, and the lookups of the same-name entries of the other catalog in it
+static void bench_levels(void) {
+    static const int widths[] = {1000, 16000, 256000, 1000000};
+    for (size_t w = 0; w < sizeof(widths) / sizeof(*widths); w++) {
+        Level level;
+        level.count = widths[w];
+        level.hashes = malloc(level.count * sizeof(*level.hashes));
+        NULL_CHECK(level.hashes, "malloc");
+        level.keys = malloc(level.count * sizeof(*level.keys));
+        NULL_CHECK(level.keys, "malloc");
+        level.lookups = malloc(level.count * sizeof(*level.lookups));
+        NULL_CHECK(level.lookups, "malloc");
+        size_t keyLen = sizeof("/projectDir/level/entry-") + 10;
+        level.strings = malloc(level.count * keyLen);
+        NULL_CHECK(level.strings, "malloc");
+        for (int i = 0; i < level.count; i++) {
+            level.keys[i] = i * keyLen;
+            snprintf(level.strings + level.keys[i], keyLen, "/projectDir/level/entry-%07d", i);
+            level.hashes[i] = hash_string(level.strings + level.keys[i]);
+            level.lookups[i] = duplicate_string(level.strings + level.keys[i]);
+        }
+        level.index = hash_index_create(level.hashes, level.strings, level.keys, 0, level.count);
+
+        bench("match/build", level.count, run_level_build, &level, 0);
+        bench("match/find", level.count, run_level_find, &level, 0);
+
+        hash_index_destroy(level.index);
+        for (int i = 0; i < level.count; i++) free(level.lookups[i]);
+        free(level.lookups);
+        free(level.strings);
+        free(level.keys);
+        free(level.hashes);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [<part of the names of the benchmarks to run>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (argc == 2) filter = argv[1];
+
+    // The routines count what they do, as in a run of cmpcat
+    stats_init();
+    // The comparisons run through the default tiers, without a signature cache
+    info = calloc(1, sizeof(*info));
+    NULL_CHECK(info, "calloc");
+    info->options.tiers = TIER_DEFAULT;
+    info->cache = NULL;
+
+    char *tmp = getenv("TMPDIR");
+    char *template = concatinate((tmp != NULL && *tmp != '\0') ? tmp : "/tmp", "cmpcat-bench-XXXXXX");
+    if (mkdtemp(template) == NULL) {
+        perror("mkdtemp()");
+        exit(EXIT_FAILURE);
+    }
+    workDir = concatinate(template, "");
+
+    printf("%-24s %10s %16s %10s\n", "benchmark", "param", "ops/s", "GB/s");
+    bench_first_difference();
+    bench_verdict();
+    bench_copy();
+    bench_paths();
+    bench_links();
+    bench_levels();
+
+    if (rmdir(template) == -1) {
+        perror("rmdir()");
+        exit(EXIT_FAILURE);
+    }
+    free(template);
+    free(workDir);
+    free(info);
+    stats_destroy();
+    return 0;
+}
@@ -0,0 +1,824 @@
+#define _GNU_SOURCE                 // nftw() etc.
+
+#include <errno.h>          // errno
+#include <fcntl.h>          // open() etc.
+#include <ftw.h>            // nftw()
+#include <getopt.h>         // getopt_long() etc.
+#include <limits.h>         // PATH_MAX
+#include <stdint.h>         // uint64_t
+#include <stdio.h>          // fprintf() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strcmp() etc.
+#include <sys/resource.h>   // struct rusage
+#include <sys/stat.h>       // mkdir() etc.
+#include <sys/wait.h>       // wait4() etc.
+#include <time.h>           // clock_gettime()
+#include <unistd.h>         // fork() etc.
+
+#include "utils.h"          // NULL_CHECK() etc.
+
+// End-to-end scale harness. For every number of entries given, generates a pair of hierarchies of that
+// size, runs cmpcat on them in compare mode and in merge mode, and prints a line per run with the wall
+// time, the peak resident memory and the I/O of cmpcat, and whether its output was right. The generator
+// knows every difference it makes, and the merged hierarchy that it expects, so the differences that
+// cmpcat prints and the hierarchy it merges are checked against those references, entry by entry
+// NOTE: The shape of the hierarchies (depth, fan-out, file sizes, and the fractions of identical, modified
+// and missing files, of hardlinks and of symlinks) is set by the options, and the same seed always gives
+// the same hierarchies. Everything is generated in $TMPDIR (or /tmp) and removed after every size
+// With --max-growth, the harness also checks how cmpcat scales: the time of a comparison may grow at most
+// that many times faster than its entries from one size to the next, or its check fails
+
+// Sides that an entry exists in
+#define SIDE_A    1
+#define SIDE_B    2
+#define SIDE_BOTH (SIDE_A | SIDE_B)
+
+// States of an entry that exists in both sides, or of one that is missing from one of them
+#define STATE_IDENTICAL 'i'
+#define STATE_MODIFIED  'm'
+#define STATE_ONLY_A    'a'
+#define STATE_ONLY_B    'b'
+
+// Modification times of the generated files. The newer side of a modified file is the one that gets merged
+#define TIME_OLDER 1577836800
+#define TIME_NEWER (TIME_OLDER + 3600)
+
+// Lines of the reference files that differ from the output of cmpcat, and are printed to stderr
+#define SHOWN_MISMATCHES 5
+// Most files of a directory, unless the user chooses the depth
+#define DIRECTORY_FILES 100
+
+// Shape of the generated hierarchies
+typedef struct {
+    int depth;              // Levels of directories below the root. -1 to have about DIRECTORY_FILES files per directory
+    int fanout;             // Subdirectories of every directory above the last level
+    long minSize;           // Smallest file size
+    long maxSize;           // Largest file size. Sizes are spread evenly over their powers of 2
+    double identical;       // Fraction of the files of both sides that are the same
+    double modified;        // Fraction of the files of both sides that differ in contents, size or type
+    double missing;         // Fraction of the files found in a single side
+    double missingDirs;     // Fraction of the subdirectories found in a single side, with their whole subtree
+    double hardlinks;       // Fraction of the files that belong to groups of 2 to 4 hardlinks
+    double symlinks;        // Fraction of the entries that are symlinks to a file of the same hierarchy
+    double outside;         // Fraction of the entries that are symlinks to a file outside of the hierarchies
+    unsigned long seed;     // Seed of every random choice
+} Shape;
+
+// Resources that a run of cmpcat used, as the kernel accounted them
+typedef struct {
+    double seconds;         // Wall time
+    long maxRss;            // Peak resident memory, in KiB
+    unsigned long long readChars, writeChars;   // Bytes passed to read and write system calls
+    unsigned long long readBytes, writeBytes;   // Bytes fetched from and sent to storage
+    int status;             // Status as returned by wait4()
+} Usage;
+
+static Shape shape = {
+    .depth = -1, .fanout = 8, .minSize = 0, .maxSize = 4096,
+    .identical = 0.8, .modified = 0.1, .missing = 0.1, .missingDirs = 0.01,
+    .hardlinks = 0.02, .symlinks = 0.02, .outside = 0.01, .seed = 1
+};
+
+static uint64_t randomState;    // State of the generator of random numbers
+static char *root;              // Directory of the current size, with a trailing '/'
+static FILE *differences;       // Reference of the differences, as lines of side, reason and path
+static FILE *merged;            // Reference of the merged hierarchy, as lines of path, type, size and contents
+static long filesPerDir;        // Files of every directory, derived from the number of entries asked for
+static long entries;            // Entries generated in both sides
+static long difference;         // Differences in the reference
+static double maxGrowth;        // Most growth of the time of a comparison over the growth of its entries. 0 if unchecked
+static double lastSeconds;      // Time and entries of the last comparison, that the next one is checked against
+static long lastEntries;
+
+// Print how the program should be used and exit
+static void usage(char *exe) {
+    fprintf(stderr, "Usage: %s [--cmpcat=<path>] [--depth=<levels>] [--fanout=<subdirectories>] [--min-size=<bytes>]\n"
+                    "       [--max-size=<bytes>] [--identical=<fraction>] [--modified=<fraction>] [--missing=<fraction>]\n"
+                    "       [--missing-dirs=<fraction>] [--hardlinks=<fraction>] [--symlinks=<fraction>] [--outside=<fraction>]\n"
+                    "       [--seed=<number>] [--keep] [--compare-only] [--max-growth=<factor>] <entries>... [-- <options of cmpcat>]\n", exe);
+    exit(EXIT_FAILURE);
+}
+
+// SplitMix64, so that the same seed gives the same hierarchies everywhere
+static uint64_t random_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Returns a random number in [0, 1)
+static double random_fraction(void) {
+    return (random_next(&randomState) >> 11) * 0x1.0p-53;
+}
+
+// Returns a random file size. Every power of 2 up to the largest size is as likely, so most files are small
+static long random_size(void) {
+    long range = shape.maxSize - shape.minSize;
+    int bits = 0;
+    while (bits < 62 && (1l << bits) <= range) bits++;
+    long size = shape.minSize + (long)(random_next(&randomState) % (1ul << (random_next(&randomState) % (bits + 1))));
+    return (size > shape.maxSize) ? shape.maxSize : size;
+}
+
+// Store the path of 'relative' in given side (or in any other directory of the root) in 'path'
+static void path_of(char *side, char *relative, char path[PATH_MAX]) {
+    if (snprintf(path, PATH_MAX, "%s%s/%s", root, side, relative) >= PATH_MAX) {
+        fprintf(stderr, "Path too long: %s%s/%s\n", root, side, relative);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static char *side_name(int side) {
+    return (side == SIDE_A) ? "A" : "B";
+}
+
+// Set the modification time of given path, without following symlinks
+static void mtime_set(char *path, time_t mtime) {
+    struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    if (utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW) == -1) {
+        perror("utimensat()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Create a file of 'size' bytes in given side, whose contents follow from 'seed'. If 'flip' is not -1, the
+// byte at that offset is inverted. Returns the FNV-1a hash of the contents
+static uint64_t file_make(int side, char *relative, long size, uint64_t seed, long flip, time_t mtime) {
+    char path[PATH_MAX];
+    path_of(side_name(side), relative, path);
+    int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t hash = 0xCBF29CE484222325ull;
+    char buffer[16 * BUFLEN];
+    for (long offset = 0; offset < size; offset += sizeof(buffer)) {
+        size_t len = (size - offset < (long)sizeof(buffer)) ? (size_t)(size - offset) : sizeof(buffer);
+        for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+            uint64_t word = random_next(&seed);
+            memcpy(buffer + i, &word, (len - i < sizeof(word)) ? len - i : sizeof(word));
+        }
+        if (flip >= offset && flip < offset + (long)len) buffer[flip - offset] = ~buffer[flip - offset];
+        for (size_t i = 0; i < len; i++) hash = (hash ^ (unsigned char)buffer[i]) * 0x100000001B3ull;
+        fullwrite(fd, buffer, len);
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    mtime_set(path, mtime);
+    entries++;
+    return hash;
+}
+
+// Create a directory in given side
+static void directory_make(int side, char *relative) {
+    char path[PATH_MAX];
+    path_of(side_name(side), relative, path);
+    if (mkdir(path, 0755) == -1) {
+        perror("mkdir()");
+        exit(EXIT_FAILURE);
+    }
+    entries++;
+}
+
+// Create a symlink to 'target' in given side
+static void symlink_make(int side, char *relative, char *target) {
+    char path[PATH_MAX];
+    path_of(side_name(side), relative, path);
+    if (symlink(target, path) == -1) {
+        perror("symlink()");
+        exit(EXIT_FAILURE);
+    }
+    entries++;
+}
+
+// Create a hardlink to 'existing' in given side
+static void hardlink_make(int side, char *existing, char *relative) {
+    char from[PATH_MAX], to[PATH_MAX];
+    path_of(side_name(side), existing, from);
+    path_of(side_name(side), relative, to);
+    if (link(from, to) == -1) {
+        perror("link()");
+        exit(EXIT_FAILURE);
+    }
+    entries++;
+}
+
+// Add a difference to the reference. 'reason' is named as cmpcat names it
+static void expect_difference(int side, char *reason, char *relative) {
+    fprintf(differences, "%s\t%s\t%s\n", side_name(side), reason, relative);
+    difference++;
+}
+
+// Add an entry of the merged hierarchy to the reference. Type is 'f' for files, 'h' for files with more
+// than one name, 'd' for directories and 'l' for symlinks. Contents are the hash of a file or a symlink's target
+static void expect_merged(char *relative, char type, long size, uint64_t hash, char *target) {
+    if (type == 'd') fprintf(merged, "%s\td\t0\t-\n", relative);
+    else if (type == 'l') fprintf(merged, "%s\tl\t%ld\t%s\n", relative, size, target);
+    else fprintf(merged, "%s\t%c\t%ld\t%016llx\n", relative, type, size, (unsigned long long)hash);
+}
+
+// Pick the state of an entry found in given sides
+static char state_pick(int sides) {
+    if (sides == SIDE_A) return STATE_ONLY_A;
+    if (sides == SIDE_B) return STATE_ONLY_B;
+    double u = random_fraction() * (shape.identical + shape.modified + shape.missing);
+    if (u < shape.identical) return STATE_IDENTICAL;
+    if (u < shape.identical + shape.modified) return STATE_MODIFIED;
+    return (random_fraction() < 0.5) ? STATE_ONLY_A : STATE_ONLY_B;
+}
+
+// Generate a regular file. A modified file differs in a single byte, in its size, or is a directory in B
+static void regular_generate(char *relative, char state) {
+    long size = random_size();
+    uint64_t seed = random_next(&randomState);
+    if (state == STATE_ONLY_A || state == STATE_ONLY_B) {
+        int side = (state == STATE_ONLY_A) ? SIDE_A : SIDE_B;
+        uint64_t hash = file_make(side, relative, size, seed, -1, TIME_OLDER);
+        expect_difference(side, "missing", relative);
+        expect_merged(relative, 'f', size, hash, NULL);
+        return;
+    }
+    if (state == STATE_IDENTICAL) {
+        file_make(SIDE_A, relative, size, seed, -1, TIME_OLDER);
+        uint64_t hash = file_make(SIDE_B, relative, size, seed, -1, TIME_OLDER);
+        expect_merged(relative, 'f', size, hash, NULL);
+        return;
+    }
+
+    double kind = random_fraction();
+    // A new directory is newer than any generated file, so it is the one merged
+    if (kind < 0.1) {
+        file_make(SIDE_A, relative, size, seed, -1, TIME_OLDER);
+        directory_make(SIDE_B, relative);
+        expect_difference(SIDE_A, "type-mismatch", relative);
+        expect_difference(SIDE_B, "type-mismatch", relative);
+        expect_merged(relative, 'd', 0, 0, NULL);
+        return;
+    }
+    // Either side may be the newer one. Empty files can only differ in size
+    int newer = (random_fraction() < 0.5) ? SIDE_A : SIDE_B;
+    long sizeA = size, sizeB = size, flip = -1;
+    if (kind < 0.55 && size > 0) flip = (long)(random_next(&randomState) % size);
+    else sizeB = size + 1 + (long)(random_next(&randomState) % 64);
+    uint64_t hashA = file_make(SIDE_A, relative, sizeA, seed, flip, (newer == SIDE_A) ? TIME_NEWER : TIME_OLDER);
+    uint64_t hashB = file_make(SIDE_B, relative, sizeB, seed, -1, (newer == SIDE_B) ? TIME_NEWER : TIME_OLDER);
+    char *reason = (sizeA != sizeB) ? "size" : "content";
+    expect_difference(SIDE_A, reason, relative);
+    expect_difference(SIDE_B, reason, relative);
+    if (newer == SIDE_A) expect_merged(relative, 'f', sizeA, hashA, NULL);
+    else expect_merged(relative, 'f', sizeB, hashB, NULL);
+}
+
+// Generate a group of hardlinks, whose first name is 'relative' and the rest have a suffix. A modified
+// group differs in a single byte, and is newer in A
+static void hardlinks_generate(char *relative, char state) {
+    int names = 2 + (int)(random_next(&randomState) % 3);
+    long size = random_size();
+    if (state == STATE_MODIFIED && size == 0) size = 1;
+    uint64_t seed = random_next(&randomState);
+    long flip = (state == STATE_MODIFIED) ? (long)(random_next(&randomState) % size) : -1;
+    time_t mtimeA = (state == STATE_MODIFIED) ? TIME_NEWER : TIME_OLDER;
+
+    uint64_t hash = 0;
+    int sides = (state == STATE_ONLY_A) ? SIDE_A : (state == STATE_ONLY_B) ? SIDE_B : SIDE_BOTH;
+    for (int side = SIDE_A; side <= SIDE_B; side++) {
+        if (!(sides & side)) continue;
+        uint64_t sideHash = file_make(side, relative, size, seed, (side == SIDE_A) ? flip : -1, (side == SIDE_A) ? mtimeA : TIME_OLDER);
+        if (side == SIDE_A || state != STATE_MODIFIED) hash = sideHash;
+        for (int k = 1; k < names; k++) {
+            char name[PATH_MAX + 8];
+            snprintf(name, sizeof(name), "%s-%d", relative, k);
+            hardlink_make(side, relative, name);
+        }
+    }
+    for (int k = 0; k < names; k++) {
+        char name[PATH_MAX + 8];
+        if (k == 0) snprintf(name, sizeof(name), "%s", relative);
+        else snprintf(name, sizeof(name), "%s-%d", relative, k);
+        if (sides != SIDE_BOTH) expect_difference(sides, "missing", name);
+        else if (state == STATE_MODIFIED) {
+            expect_difference(SIDE_A, "content", name);
+            expect_difference(SIDE_B, "content", name);
+        }
+        expect_merged(name, 'h', size, hash, NULL);
+    }
+}
+
+// Generate a symlink to the first file of its directory, which both sides have
+// NOTE: cmpcat compares symlinks by the paths they resolve to, which lie in different hierarchies,
+// so a symlink that both sides have is always a difference
+static void symlink_generate(char *relative, char state) {
+    char target[] = "f0";
+    int sides = (state == STATE_ONLY_A) ? SIDE_A : (state == STATE_ONLY_B) ? SIDE_B : SIDE_BOTH;
+    for (int side = SIDE_A; side <= SIDE_B; side++) {
+        if (!(sides & side)) continue;
+        symlink_make(side, relative, target);
+        expect_difference(side, (sides == SIDE_BOTH) ? "content" : "missing", relative);
+    }
+    expect_merged(relative, 'l', strlen(target), 0, target);
+}
+
+// Generate a symlink to a file outside of both hierarchies, which cmpcat ignores
+static void outside_generate(char *relative, int sides) {
+    char target[PATH_MAX];
+    path_of("outside", "target", target);
+    for (int side = SIDE_A; side <= SIDE_B; side++) {
+        if (sides & side) symlink_make(side, relative, target);
+    }
+}
+
+// Generate the directory 'relative' (empty for the root) of given sides, its files and its subtree
+static void directory_generate(char *relative, int level, int sides) {
+    char child[PATH_MAX];
+    char *slash = (*relative != '\0') ? "/" : "";
+    for (long k = 0; k < filesPerDir; k++) {
+        snprintf(child, sizeof(child), "%s%sf%ld", relative, slash, k);
+        // The first file is always the same, so that symlinks have a target in both sides
+        if (k == 0) {
+            regular_generate(child, (sides == SIDE_BOTH) ? STATE_IDENTICAL : state_pick(sides));
+            continue;
+        }
+        double kind = random_fraction();
+        if (kind < shape.hardlinks) hardlinks_generate(child, state_pick(sides));
+        else if (kind < shape.hardlinks + shape.symlinks) symlink_generate(child, state_pick(sides));
+        else if (kind < shape.hardlinks + shape.symlinks + shape.outside) outside_generate(child, sides);
+        else regular_generate(child, state_pick(sides));
+    }
+    if (level == shape.depth) return;
+
+    for (int d = 0; d < shape.fanout; d++) {
+        snprintf(child, sizeof(child), "%s%sd%d", relative, slash, d);
+        int childSides = sides;
+        if (sides == SIDE_BOTH && random_fraction() < shape.missingDirs) childSides = (random_fraction() < 0.5) ? SIDE_A : SIDE_B;
+        for (int side = SIDE_A; side <= SIDE_B; side++) {
+            if (childSides & side) directory_make(side, child);
+        }
+        if (childSides != SIDE_BOTH) expect_difference(childSides, "missing", child);
+        expect_merged(child, 'd', 0, 0, NULL);
+        directory_generate(child, level + 1, childSides);
+    }
+}
+
+static FILE *reference_open(char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", root, name);
+    FILE *file = fopen(path, "w");
+    NULL_CHECK(file, "fopen");
+    return file;
+}
+
+static void reference_close(FILE *file) {
+    if (fclose(file) == EOF) {
+        perror("fclose()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Generate both hierarchies in the root, with about 'count' entries each, along with their references
+static void hierarchies_generate(long count, int depth) {
+    // Directories below the root, and files of every directory so that the entries add up to 'count'
+    long directories = 0, width = 1;
+    shape.depth = 0;
+    while (depth == -1 ? (count - directories) / (directories + 1) > DIRECTORY_FILES : shape.depth < depth) {
+        width *= shape.fanout;
+        directories += width;
+        shape.depth++;
+    }
+    filesPerDir = (count - directories) / (directories + 1);
+    if (filesPerDir < 1) filesPerDir = 1;
+    entries = 0;
+    difference = 0;
+    randomState = shape.seed;
+
+    char path[PATH_MAX];
+    char *dirs[] = {"A", "B", "C", "outside"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(*dirs); i++) {
+        // The merged hierarchy is created by cmpcat
+        if (!strcmp(dirs[i], "C")) continue;
+        snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+        if (mkdir(path, 0755) == -1) {
+            perror("mkdir()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    path_of("outside", "target", path);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    if (fd == -1 || close(fd) == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+
+    differences = reference_open("expected-differences");
+    merged = reference_open("expected-merge");
+    directory_generate("", 0, SIDE_BOTH);
+    reference_close(differences);
+    reference_close(merged);
+}
+
+// Read the counter called 'name' from the text of /proc/<pid>/io
+static unsigned long long io_counter(char *text, char *name) {
+    char *found = strstr(text, name);
+    return (found != NULL) ? strtoull(found + strlen(name), NULL, 10) : 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime()");
+        exit(EXIT_FAILURE);
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run cmpcat with given arguments in the root, with its output written to file 'output' of the root
+static void cmpcat_run(char **argv, char *output, Usage *usage) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", root, output);
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork()");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1 || chdir(root) == -1) {
+            perror("cmpcat");
+            _exit(127);
+        }
+        execv(argv[0], argv);
+        perror("execv()");
+        _exit(127);
+    }
+
+    // The I/O counters of a process can only be read until it is reaped
+    siginfo_t info;
+    if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == -1) {
+        perror("waitid()");
+        exit(EXIT_FAILURE);
+    }
+    usage->seconds = now() - start;
+    char ioPath[64], text[1024] = "";
+    snprintf(ioPath, sizeof(ioPath), "/proc/%d/io", (int)pid);
+    FILE *io = fopen(ioPath, "r");
+    if (io != NULL) {
+        size_t n = fread(text, 1, sizeof(text) - 1, io);
+        text[n] = '\0';
+        fclose(io);
+    }
+    usage->readChars = io_counter(text, "rchar: ");
+    usage->writeChars = io_counter(text, "wchar: ");
+    usage->readBytes = io_counter(text, "\nread_bytes: ");
+    usage->writeBytes = io_counter(text, "\nwrite_bytes: ");
+
+    struct rusage resources;
+    if (wait4(pid, &usage->status, 0, &resources) == -1) {
+        perror("wait4()");
+        exit(EXIT_FAILURE);
+    }
+    usage->maxRss = resources.ru_maxrss;
+}
+
+// Convert the differences that cmpcat printed with --format=nul to lines of the reference's format
+// NOTE: Every record is side, type, reason, size, size of the same-name entry, and the path, which
+// starts with the path of its hierarchy as given to cmpcat
+static void differences_convert(char *output, char *lines) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", root, output);
+    FILE *in = fopen(path, "r");
+    NULL_CHECK(in, "fopen");
+    FILE *out = reference_open(lines);
+    char *record = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    while ((len = getdelim(&record, &capacity, '\0', in)) > 0) {
+        char *fields[6];
+        fields[0] = record;
+        for (int i = 1; i < 6; i++) {
+            fields[i] = strchr(fields[i-1], '\t');
+            if (fields[i] == NULL) break;
+            *fields[i]++ = '\0';
+        }
+        if (fields[5] == NULL) {
+            fprintf(stderr, "Malformed record in %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+        // Skip the "./A/" or "./B/" that every path starts with
+        char *relative = fields[5];
+        if (!strncmp(relative, "./", 2)) relative += 2;
+        relative = strchr(relative, '/');
+        fprintf(out, "%s\t%s\t%s\n", fields[0], fields[2], (relative != NULL) ? relative + 1 : fields[5]);
+    }
+    free(record);
+    fclose(in);
+    reference_close(out);
+}
+
+static FILE *walked;        // Lines of the merged hierarchy, as walked
+static size_t walkedRoot;   // Length of the path of the merged hierarchy, with its trailing '/'
+
+// Add an entry of the merged hierarchy to the lines of 'walked', in the format of expect_merged()
+static int merged_walk(const char *path, const struct stat *myStat, int flag, struct FTW *ftw) {
+    (void)flag;
+    if (ftw->level == 0) return 0;
+    const char *relative = path + walkedRoot;
+    if (S_ISDIR(myStat->st_mode)) fprintf(walked, "%s\td\t0\t-\n", relative);
+    else if (S_ISLNK(myStat->st_mode)) {
+        char target[PATH_MAX];
+        ssize_t n = readlink(path, target, sizeof(target) - 1);
+        if (n == -1) {
+            perror("readlink()");
+            exit(EXIT_FAILURE);
+        }
+        target[n] = '\0';
+        fprintf(walked, "%s\tl\t%lld\t%s\n", relative, (long long)myStat->st_size, target);
+    }
+    else {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            perror("open()");
+            exit(EXIT_FAILURE);
+        }
+        uint64_t hash = 0xCBF29CE484222325ull;
+        char buffer[16 * BUFLEN];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t i = 0; i < n; i++) hash = (hash ^ (unsigned char)buffer[i]) * 0x100000001B3ull;
+        }
+        if (n == -1 || close(fd) == -1) {
+            perror("read()");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(walked, "%s\t%c\t%lld\t%016llx\n", relative, (myStat->st_nlink > 1) ? 'h' : 'f',
+                (long long)myStat->st_size, (unsigned long long)hash);
+    }
+    return 0;
+}
+
+// Write the lines of the merged hierarchy to file 'lines' of the root
+static void merged_convert(char *lines) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%sC/", root);
+    walked = reference_open(lines);
+    walkedRoot = strlen(path);
+    // A merged hierarchy that was never created has no lines
+    if (nftw(path, merged_walk, 64, FTW_PHYS) == -1 && errno != ENOENT) {
+        perror("nftw()");
+        exit(EXIT_FAILURE);
+    }
+    reference_close(walked);
+}
+
+// Lines of a file, sorted
+typedef struct {
+    char *text;
+    char **lines;
+    size_t count;
+} Lines;
+
+static int compare_lines(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void lines_load(char *name, Lines *lines) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", root, name);
+    int fd = open(path, O_RDONLY);
+    struct stat myStat;
+    if (fd == -1 || fstat(fd, &myStat) == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    lines->text = malloc(myStat.st_size + 1);
+    NULL_CHECK(lines->text, "malloc");
+    fullread(fd, lines->text, myStat.st_size);
+    lines->text[myStat.st_size] = '\0';
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t capacity = 1024;
+    lines->lines = malloc(capacity * sizeof(*lines->lines));
+    NULL_CHECK(lines->lines, "malloc");
+    lines->count = 0;
+    for (char *line = lines->text, *end; *line != '\0'; line = end + 1) {
+        end = strchr(line, '\n');
+        *end = '\0';
+        if (lines->count == capacity) {
+            capacity *= 2;
+            lines->lines = realloc(lines->lines, capacity * sizeof(*lines->lines));
+            NULL_CHECK(lines->lines, "realloc");
+        }
+        lines->lines[lines->count++] = line;
+    }
+    qsort(lines->lines, lines->count, sizeof(*lines->lines), compare_lines);
+}
+
+// Compare the lines of the reference 'expected' to the lines of 'actual', both files of the root. Returns
+// the lines found in only one of them, and prints the first few of them to stderr
+static long lines_compare(char *expected, char *actual) {
+    Lines want, got;
+    lines_load(expected, &want);
+    lines_load(actual, &got);
+    long mismatches = 0;
+    size_t i = 0, j = 0;
+    while (i < want.count || j < got.count) {
+        int order = (i == want.count) ? 1 : (j == got.count) ? -1 : strcmp(want.lines[i], got.lines[j]);
+        if (order == 0) {
+            i++;
+            j++;
+            continue;
+        }
+        if (mismatches++ < SHOWN_MISMATCHES) {
+            fprintf(stderr, "%s: %s %s\n", actual, (order < 0) ? "missing" : "unexpected", (order < 0) ? want.lines[i] : got.lines[j]);
+        }
+        if (order < 0) i++;
+        else j++;
+    }
+    free(want.text);
+    free(want.lines);
+    free(got.text);
+    free(got.lines);
+    return mismatches;
+}
+
+// Print a line of the results
+static void result_print(long count, char *mode, Usage *usage, char *check) {
+    printf("%-10ld %-10ld %-8s %10.3f %12ld %12.1f %12.1f %12.1f %12.1f %-8ld %s\n", count, entries, mode, usage->seconds,
+           usage->maxRss, usage->readChars / 1048576.0, usage->writeChars / 1048576.0, usage->readBytes / 1048576.0,
+           usage->writeBytes / 1048576.0, difference, check);
+    fflush(stdout);
+}
+
+// Run cmpcat in given mode with the options of the user, and check its output. Returns true if it was right
+static int mode_run(char *cmpcat, char **extra, int extraCount, long count, int merge) {
+    char *argv[extraCount + 8];
+    int argc = 0;
+    argv[argc++] = cmpcat;
+    for (int i = 0; i < extraCount; i++) argv[argc++] = extra[i];
+    argv[argc++] = "--format=nul";
+    argv[argc++] = "-d";
+    argv[argc++] = "A";
+    argv[argc++] = "B";
+    if (merge) {
+        argv[argc++] = "-s";
+        argv[argc++] = "C";
+    }
+    argv[argc] = NULL;
+
+    Usage usage;
+    cmpcat_run(argv, "output", &usage);
+    char check[64] = "ok";
+    if (!WIFEXITED(usage.status) || WEXITSTATUS(usage.status) != 0) {
+        snprintf(check, sizeof(check), "FAIL(status=%d)", usage.status);
+    }
+    else {
+        differences_convert("output", "actual-differences");
+        long mismatches = lines_compare("expected-differences", "actual-differences");
+        if (merge) {
+            merged_convert("actual-merge");
+            mismatches += lines_compare("expected-merge", "actual-merge");
+        }
+        if (mismatches > 0) snprintf(check, sizeof(check), "FAIL(mismatches=%ld)", mismatches);
+    }
+    // Near-linear scaling means that the time grows about as much as the entries do
+    if (!merge && maxGrowth > 0) {
+        double growth = (lastEntries > 0) ? (usage.seconds / lastSeconds) / ((double)entries / lastEntries) : 0;
+        if (growth > maxGrowth && !strcmp(check, "ok")) snprintf(check, sizeof(check), "FAIL(growth=%.1f)", growth);
+        lastSeconds = (usage.seconds > 0) ? usage.seconds : 1e-6;
+        lastEntries = entries;
+    }
+    result_print(count, merge ? "merge" : "compare", &usage, check);
+    return !strcmp(check, "ok");
+}
+
+static int tree_remove_entry(const char *path, const struct stat *myStat, int flag, struct FTW *ftw) {
+    (void)myStat;
+    (void)flag;
+    (void)ftw;
+    if (remove(path) == -1) {
+        perror("remove()");
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+// Remove a whole directory
+static void tree_remove(char *path) {
+    if (nftw(path, tree_remove_entry, 64, FTW_DEPTH | FTW_PHYS) == -1 && errno != ENOENT) {
+        perror("nftw()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Parse a fraction given as an option arguement
+static double parse_fraction(char *exe, char *arg) {
+    char *end;
+    double fraction = strtod(arg, &end);
+    if (*arg == '\0' || *end != '\0' || fraction < 0 || fraction > 1) usage(exe);
+    return fraction;
+}
+
+// Parse a non-negative number given as an option arguement. Accepts exponents, as in 1e6
+static long parse_number(char *exe, char *arg) {
+    char *end;
+    double number = strtod(arg, &end);
+    if (*arg == '\0' || *end != '\0' || number < 0 || number > 1e15) usage(exe);
+    return (long)number;
+}
+
+int main(int argc, char *argv[]) {
+    static struct option longOptions[] = {
+        {"cmpcat", required_argument, NULL, 'c'},
+        {"depth", required_argument, NULL, 'd'},
+        {"fanout", required_argument, NULL, 'f'},
+        {"min-size", required_argument, NULL, 'n'},
+        {"max-size", required_argument, NULL, 'x'},
+        {"identical", required_argument, NULL, 'i'},
+        {"modified", required_argument, NULL, 'm'},
+        {"missing", required_argument, NULL, 'g'},
+        {"missing-dirs", required_argument, NULL, 'G'},
+        {"hardlinks", required_argument, NULL, 'h'},
+        {"symlinks", required_argument, NULL, 's'},
+        {"outside", required_argument, NULL, 'o'},
+        {"seed", required_argument, NULL, 'S'},
+        {"keep", no_argument, NULL, 'k'},
+        {"compare-only", no_argument, NULL, 'C'},
+        {"max-growth", required_argument, NULL, 'M'},
+        {NULL, 0, NULL, 0}
+    };
+    char *cmpcat = "./cmpcat";
+    int keep = 0, compareOnly = 0;
+    int opt;
+    // Options end at the first number of entries
+    while ((opt = getopt_long(argc, argv, "+", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'c': cmpcat = optarg; break;
+            case 'd': shape.depth = (int)parse_number(argv[0], optarg); break;
+            case 'f': shape.fanout = (int)parse_number(argv[0], optarg); break;
+            case 'n': shape.minSize = parse_number(argv[0], optarg); break;
+            case 'x': shape.maxSize = parse_number(argv[0], optarg); break;
+            case 'i': shape.identical = parse_fraction(argv[0], optarg); break;
+            case 'm': shape.modified = parse_fraction(argv[0], optarg); break;
+            case 'g': shape.missing = parse_fraction(argv[0], optarg); break;
+            case 'G': shape.missingDirs = parse_fraction(argv[0], optarg); break;
+            case 'h': shape.hardlinks = parse_fraction(argv[0], optarg); break;
+            case 's': shape.symlinks = parse_fraction(argv[0], optarg); break;
+            case 'o': shape.outside = parse_fraction(argv[0], optarg); break;
+            case 'S': shape.seed = (unsigned long)parse_number(argv[0], optarg); break;
+            case 'k': keep = 1; break;
+            case 'C': compareOnly = 1; break;
+            case 'M':
+                if ((maxGrowth = strtod(optarg, NULL)) <= 0) usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    int depth = shape.depth;
+    if (shape.minSize > shape.maxSize || shape.fanout < 1 || shape.identical + shape.modified + shape.missing <= 0 ||
+        shape.hardlinks + shape.symlinks + shape.outside > 1) usage(argv[0]);
+
+    // Numbers of entries, then the options of cmpcat
+    int counts = optind, extra = optind;
+    while (extra < argc && strcmp(argv[extra], "--")) extra++;
+    if (extra == counts) usage(argv[0]);
+    int countEnd = extra;
+    if (extra < argc) extra++;
+    for (int c = counts; c < countEnd; c++) parse_number(argv[0], argv[c]);
+
+    char *exe = realpath(cmpcat, NULL);
+    NULL_CHECK(exe, "realpath");
+    char *tmp = getenv("TMPDIR");
+
+    // Entries are asked for each hierarchy, and counted in both
+    printf("%-10s %-10s %-8s %10s %12s %12s %12s %12s %12s %-8s %s\n", "asked", "entries", "mode", "seconds", "maxRssKiB",
+           "readMiB", "writtenMiB", "diskReadMiB", "diskWriteMiB", "diffs", "check");
+    int failed = 0;
+    for (int c = counts; c < countEnd; c++) {
+        long count = parse_number(argv[0], argv[c]);
+        char *template = concatinate((tmp != NULL && *tmp != '\0') ? tmp : "/tmp", "cmpcat-scale-XXXXXX");
+        if (mkdtemp(template) == NULL) {
+            perror("mkdtemp()");
+            exit(EXIT_FAILURE);
+        }
+        root = concatinate(template, "");
+
+        double start = now();
+        hierarchies_generate(count, depth);
+        fprintf(stderr, "Generated %ld entries in %s in %.1f s\n", entries, template, now() - start);
+
+        failed |= !mode_run(exe, argv + extra, argc - extra, count, 0);
+        if (!compareOnly) failed |= !mode_run(exe, argv + extra, argc - extra, count, 1);
+
+        if (!keep) tree_remove(template);
+        free(template);
+        free(root);
+    }
+    free(exe);
+    return failed ? EXIT_FAILURE : 0;
+}
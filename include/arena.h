@@ -0,0 +1,19 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>     // size_t
+
+typedef struct arena Arena;
+
+// Initializes and returns an empty arena. Memory is reserved from the system in chunks of
+// 'chunkSize' bytes, and handed out by bumping a pointer inside the current chunk
+Arena *arena_create(size_t chunkSize);
+
+// Returns 'size' bytes of memory, aligned for any pointer or integer type.
+// The memory can't be freed on its own, only along with the whole arena
+void *arena_alloc(Arena *arena, size_t size);
+
+// Destroys given arena, along with every allocation made in it
+void arena_destroy(Arena *arena);
+
+#endif
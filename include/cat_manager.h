@@ -1,12 +1,37 @@
 #ifndef CAT_MANAGER_H
 #define CAT_MANAGER_H 
 
+#define SAME      'S'
+#define MISSING   'M'
+#define MISMATCH  'T'
+#define DIFFERENT 'D'
+#define PENDING   'P'   // Verdict of a pair whose contents are still being compared
+#define VANISHED  'V'   // Verdict of a pair one of whose entries no longer existed when its contents were compared
+
 #include "wrapper.h"    // ArrayWrapper
 
+// Result of matching 2 catalogs. Every pair of same-name entries is compared exactly once
+// NOTE: Both verdict arrays describe the same pairs, so the differences of either side can
+// be printed, and the merge can be decided, without comparing anything a second time. Unless
+// merging, the entries below a pair of directories with the same digest get no partner, as
+// they are never looked up
+typedef struct {
+    int *partnersA;     // Position i refers to the position of the same-name entry in B of entry i in A, or -1
+    int *partnersB;     // Position j refers to the position of the same-name entry in A of entry j in B, or -1
+    char *verdictsA;    // Verdict for every entry of A. Uses #defines listed above
+    char *verdictsB;    // Verdict for every entry of B. Uses #defines listed above
+} VerdictTable;
+
+// Match the entries of 2 catalogs and compare every matched pair once
+VerdictTable *verdicts_init(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB);
+
+// Destroy a verdict table using appropriate memory deallocation
+void verdicts_destroy(VerdictTable *table);
+
 // Find and print the differences between 2 catalogs
 void find_differences(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB);
 
 // Find and print the differences between 2 catalogs. Also merge them in a new catalog
 void find_and_merge(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,18 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // off_t
+
+// Returns the offset of the first byte that differs between the 'len' bytes of 'a' and 'b',
+// or 'len' if they are equal. Uses the widest vector instructions that the CPU supports
+size_t first_difference(const void *a, const void *b, size_t len);
+
+// Compares the contents of 2 open files, both 'size' bytes long, from their start.
+// Returns the offset of the first byte that differs, or -1 if the files are equal. Files whose
+// size is no longer 'size' differ at offset 0
+// NOTE: Large files are mapped to memory, while smaller ones (and files that can't be mapped) are
+// read in buffers sized from the file size and the preferred I/O size of the filesystem
+off_t compare_files(int fdA, int fdB, off_t size);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <stdio.h>      // FILE
+#include <sys/types.h>  // off_t
+
+// Methods that the contents of a file can be copied with, from the cheapest to the most expensive one
+#define COPY_CLONE      0   // The new file shares the extents of the old one (reflink). No data is copied
+#define COPY_RANGE      1   // copy_file_range(). Data is copied inside the kernel, or offloaded to the storage
+#define COPY_SENDFILE   2   // sendfile(). Data is copied inside the kernel
+#define COPY_BUFFER     3   // read() and write() through a buffer
+#define COPY_URING      4   // Read and written through io_uring, along with many other small files (--merge=uring)
+#define COPY_METHODS    5
+
+// Copies the 'size' bytes of the open file 'fromFd' to the empty open file 'toFd'. Every method is
+// tried in turn, from the cheapest one, until one is supported by the filesystems of both files.
+// Returns the method that copied the file. Safe to call from multiple threads
+int copy_contents(int fromFd, int toFd, off_t size);
+
+// Counts a file whose contents were copied by given method outside of copy_contents()
+void copy_count(int method, off_t size);
+
+// Prints how many files, and how many bytes, every method copied. If 'json' is true,
+// prints them as a JSON object keyed by the names of the methods, without a newline
+void copy_report(FILE *stream, int json);
+
+#endif
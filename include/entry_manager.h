@@ -10,41 +10,47 @@
 #define HIER_B 'B'
 #define HIER_C 'C'
 
+#include <sys/stat.h>   // struct stat
 #include <sys/types.h>  // ino_t etc.
 
+#include "arena.h"      // Arena
+
 // Save all useful information about an entry over here
 // NOTE: This is done to avoid multiple calls of lstat() and
 // avoid passing dirents as arguements between functions
 typedef struct {
     char *relativePath;     // Relative path of entry in relation to the executable     
-    char *relativeToHier;   // Relative path of entry in relation to parent hierarchy
-    char *absolutePath;     // Absolute path of entry
-    char *name;             // Name of entry
+    char *relativeToHier;   // Relative path of entry in relation to parent hierarchy. Points inside relativePath
+    char *name;             // Name of entry. Points inside relativePath
+    dev_t device;           // Id of the device that holds the entry
     ino_t inode;            // Inode id
+    nlink_t links;          // Number of names (hardlinks) of the inode
     off_t size;             // Size of entry
     time_t mtime;           // Modification time
+    long mtimeNsec;         // Nanoseconds of the modification time
     mode_t perms;           // Entry permissions
     char fileType;          // File type of entry. Uses #defines listed above
     char fromHierarchy;     // Indicates from which hierarchy this entry comes from. Uses #defines listed above
 } EntryInfo;
 
-// Initialize an entry
-EntryInfo *entry_init(char *relativePath, char *name, char fromHierarchy);
+// Initialize an entry called 'name', found in the open directory 'dirFd' whose relative path is 'parentPath'
+// The entry is allocated in given arena
+EntryInfo *entry_init(int dirFd, char *parentPath, char *name, char fromHierarchy, Arena *arena);
 
-// Destroy an entry using appropriate memory deallocation
-void entry_destroy(EntryInfo *entry);
+// Initialize an entry whose stat is already known
+EntryInfo *entry_from_stat(struct stat *myStat, char *parentPath, char *name, char fromHierarchy, Arena *arena);
 
 // Returns true if given symlink points inside given hierarchy. False otherwise
 int symlink_in_hierachy(char *symlink, char hierarchy);
 
-// Returns true if 2 files are the same. False otherwise
-int files_are_same(EntryInfo *entryA, EntryInfo *entryB);
+// Open the file of an entry for reading. Returns -1 if the entry, or one of its parents, no longer exists
+int entry_try_open(EntryInfo *entry);
 
-// Returns true if given symlink are the same. False otherwise
-int symlinks_are_same(EntryInfo *entryA, EntryInfo *entryB);
+// Open the file of an entry for reading
+int entry_open(EntryInfo *entry);
 
-// Return true if 2 entries are the same. False otherwise
-int entries_are_same(EntryInfo *entryA, EntryInfo *entryB);
+// Returns true if given symlink are the same. False otherwise, or -1 if either of them no longer resolves
+int symlinks_are_same(EntryInfo *entryA, EntryInfo *entryB);
 
 // Copy from file 'from' to file 'to'
 void copy_file(EntryInfo *fromEntry, char *to);
@@ -55,6 +61,9 @@ void copy_symlink(EntryInfo *entry, char *newSymlink);
 // Manage the copying of the hardlinks
 void manage_hardlinks(EntryInfo *entry, char *destination);
 
+// Link 'destination' to the existing file 'target'
+void link_file(char *target, char *destination);
+
 // Create an entry to the new hierarchy
 void create_entry(EntryInfo *entry);
 
@@ -0,0 +1,26 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <stddef.h>     // size_t
+
+typedef struct hash_index HashIndex;
+
+// Builds an index over the keys [start, end). Key i is the string found at offset keys[i] of
+// 'strings' and its hash is hashes[i]. The index refers to, and does not copy, given arrays
+HashIndex *hash_index_create(unsigned long *hashes, char *strings, size_t *keys, int start, int end);
+
+// Searches for given key, whose hash is 'hash', in the index.
+// If found, returns its position in the indexed arrays, otherwise -1
+int hash_index_find(HashIndex *index, unsigned long hash, char *key);
+
+// Returns the table of slots of the index, and stores its size in bytes in 'size', so that it can be saved
+void *hash_index_table(HashIndex *index, size_t *size);
+
+// Builds an index on a table of slots that hash_index_table() returned for an index over the same keys.
+// The table is not copied, so loading an index costs the same regardless of its size
+HashIndex *hash_index_load(char *strings, size_t *keys, void *table, size_t size);
+
+// Destroys given index
+void hash_index_destroy(HashIndex *index);
+
+#endif
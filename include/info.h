@@ -1,27 +1,69 @@
 #ifndef INFO_H
 #define INFO_H
 
-#include "avltree.h"    // AVLTree
+#define SCAN_READDIR  'r'
+#define SCAN_GETDENTS 'g'
+#define SCAN_URING    'u'
+
+#define MERGE_SYNC  's'
+#define MERGE_URING 'u'
+
+#include "linktable.h"  // LinkTable
+#include "output.h"     // FORMAT_TEXT etc.
+#include "sigcache.h"   // SigCache
+#include "stats.h"      // STATS_TEXT etc.
+
+// Options given by the user in the command line
+typedef struct {
+    char *pathA;                // Path of hierarchyA, as fixed by fix_path()
+    char *pathB;                // Path of hierarchyB, as fixed by fix_path()
+    char *pathC;                // Path of hierarchyC, as fixed by fix_path(). NULL if the user only wants to compare
+    int threads;                // Number of threads that scan the hierarchies (-j)
+    int compareThreads;         // Number of threads that compare the contents of files (--compare-jobs)
+    int mergeThreads;           // Number of threads that create the entries of hierarchyC (--merge-jobs)
+    size_t maxInFlight;         // Most bytes of files that the above threads may be given at once (--max-inflight)
+    unsigned int tiers;         // Optional tiers of the comparison policy that are used (--tiers). Uses #defines of policy.h
+    int stream;                 // Whether both hierarchies are walked in lockstep instead of scanned in whole (--stream)
+    int watch;                  // Whether the changes of both hierarchies are followed after the first comparison (--watch)
+    int dryRun;                 // Whether the merge is only planned and reported, without creating hierarchyC (--dry-run)
+    int outputThread;           // Whether the differences are written by a thread of their own (--output-thread)
+    char format;                // Format of the differences (--format). Uses #defines of output.h
+    char stats;                 // Format of the statistics printed to stderr at the end (--stats). Uses #defines of stats.h
+    char scanBackend;           // How directories are read (--scan). Uses #defines listed above
+    char mergeBackend;          // How the merged entries are created (--merge). Uses #defines listed above
+    char *cachePath;            // Path of the signature cache file (--cache). NULL if no cache is used
+    char *manifestA;            // Path of the manifest that hierarchyA is loaded from instead of scanned (--manifest-a). NULL to scan it
+    char *manifestB;            // Path of the manifest that hierarchyB is loaded from instead of scanned (--manifest-b). NULL to scan it
+    char *saveManifestA;        // Path of the file that the manifest of hierarchyA is saved to (--save-manifest-a). NULL to not save it
+    char *saveManifestB;        // Path of the file that the manifest of hierarchyB is saved to (--save-manifest-b). NULL to not save it
+} Options;
 
 // Global info will be shared among the source files through a variable called 'info'
 typedef struct {
     char *hierarchyA;           // Absolute path of hierarchyA
     char *hierarchyB;           // Absolute path of hierarchyB
-    char *hierarchyC;           // Absolute path of hierarchyC
+    char *hierarchyC;           // Absolute path of hierarchyC. NULL unless merging, or if the merge is a dry run
     char *exeDir;               // Absolute path of the executable
+    char *relativeA;            // Path of hierarchyA in relation to the executable. Prefix of every relativePath of A
+    char *relativeB;            // Path of hierarchyB in relation to the executable. Prefix of every relativePath of B
 
     size_t lenA;                // Results of strlen for the above 
     size_t lenB;                // paths so we don't call strlen 
     size_t lenC;                // multiple times
     size_t lenExe;
+    size_t lenRelA;
+    size_t lenRelB;
+
+    LinkTable *hardlinks;       // Copies of the hardlinked files, so that their other names are linked to them
+    SigCache *cache;            // Signatures of file contents, kept across runs. NULL if no cache is used
 
-    AVLTree *avl_hardlinks;     // This AVL tree will be used to manage hardlinks
+    Options options;            // Options given by the user
 } GlobalInfo;
 
 // Initialize the global variable 'info'
-void info_init(int argc, char *pathA, char *pathB, char *pathC);
+void info_init(Options *options);
 
 // Destroy the global variable 'info'
-void info_destroy(int argc);
+void info_destroy(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef LINKTABLE_H
+#define LINKTABLE_H
+
+#include <sys/types.h>  // dev_t etc.
+
+typedef struct link_table LinkTable;
+
+// Initializes and returns an empty table of copied hardlinks
+// NOTE: The table maps the (device, inode) of every hardlinked file that was copied to the path
+// of its copy, along with the number of its names not yet seen. Once every name of a file was
+// seen, no other name can refer to it, so the file is removed. The table only holds the files
+// whose names were partially seen, instead of every hardlinked file
+LinkTable *link_table_create(void);
+
+// Inserts the copy 'path' of given file, which has 'links' names, including the one just copied.
+// The path is copied. Files with a single name are not inserted, as no other name can refer to them
+void link_table_insert(LinkTable *table, dev_t device, ino_t inode, nlink_t links, char *path);
+
+// Searches for the copy of given file. If found, counts one more name of the file seen, and returns
+// a copy of the path that the caller has to free. Otherwise returns NULL
+char *link_table_find(LinkTable *table, dev_t device, ino_t inode);
+
+// Destroys given table
+void link_table_destroy(LinkTable *table);
+
+#endif
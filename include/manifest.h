@@ -0,0 +1,19 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "wrapper.h"        // ArrayWrapper
+
+// Writes the columns, the levels, the string pool and the hash indexes of given wrapper to file 'path',
+// along with the signatures of the entries that the wrapper knows (see wrapper_digest()). The file is
+// written next to 'path' and renamed over it once complete
+// NOTE: Every part of the file is aligned as in memory, in the byte order and the type sizes of the
+// machine that wrote it, so that a loaded manifest uses the file in place
+void manifest_save(ArrayWrapper *wrapper, char *path);
+
+// Loads the wrapper of the hierarchy 'fromHierarchy' from the manifest in file 'path'. The file is mapped
+// to memory and only its layout is checked, so loading costs the same regardless of its number of entries
+// NOTE: A manifest is trusted to describe the hierarchy as it was when it was saved. If the hierarchy is
+// given through a different path than when it was saved, the paths of the entries are rebuilt in memory
+ArrayWrapper *manifest_load(char *path, char fromHierarchy);
+
+#endif
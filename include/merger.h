@@ -0,0 +1,29 @@
+#ifndef MERGER_H
+#define MERGER_H
+
+#include "entry_manager.h"  // EntryInfo
+
+typedef struct merger Merger;
+
+// Initializes the executor that creates the merged entries in hierarchyC. Sets up io_uring if the
+// io_uring backend was selected. If io_uring is not available, entries are created synchronously
+Merger *merger_create(void);
+
+// Creates given entry in hierarchyC, or queues its creation. Its parent directory must have been
+// queued before the last barrier. The strings of the entry must stay valid until the executor is waited for
+// NOTE: The synchronous backend hands the entries to a pool of --merge-jobs threads, in batches.
+// With io_uring, directories and small regular files are created by chains of linked requests,
+// many of them in flight at once. Larger files, hardlinks and symlinks are created synchronously
+void merger_add(Merger *merger, EntryInfo *entry);
+
+// Waits until every queued directory is created, so that the entries of the next level find their parents.
+// Files may still be in flight, as no other entry depends on them
+void merger_barrier(Merger *merger);
+
+// Waits until every queued entry is created
+void merger_wait(Merger *merger);
+
+// Waits for every queued entry, and destroys the executor
+void merger_destroy(Merger *merger);
+
+#endif
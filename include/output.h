@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#define FORMAT_TEXT  't'    // A tab and the path of every difference in a line, under a header per hierarchy
+#define FORMAT_JSONL 'j'    // A JSON object per line, with every field of a difference
+#define FORMAT_NUL   'n'    // A record per difference, whose tab separated fields end with the path and a NUL byte
+
+#include "entry_manager.h"  // EntryInfo
+
+// Prepares the writer of the differences, in the format and with the writer thread that the user chose
+// NOTE: The differences are formatted into large buffers that are written to stdout once full, instead
+// of through stdio. With a writer thread, a full buffer is handed to it, and formatting goes on in the
+// next buffer while it is written. Every function below is called from a single thread
+void output_init(void);
+
+// Writes the header of the differences of given hierarchy. Only the text format has headers
+void output_header(char fromHierarchy);
+
+// Writes an entry that has no same entry in the other hierarchy. 'verdict' is the verdict of the entry,
+// and 'partner' its same-name entry in the other hierarchy, or NULL. Uses #defines of cat_manager.h
+void output_difference(EntryInfo *entry, EntryInfo *partner, char verdict);
+
+// Writes an entry that became a difference since it was last written, as above
+void output_added(EntryInfo *entry, EntryInfo *partner, char verdict);
+
+// Writes that the entry found in 'relativePath' of given hierarchy stopped being a difference
+void output_resolved(char fromHierarchy, char *relativePath);
+
+// Writes everything formatted so far, so that a reader sees it without waiting for more differences
+void output_flush(void);
+
+// Writes everything formatted so far, and stops the writer thread
+void output_destroy(void);
+
+#endif
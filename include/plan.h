@@ -0,0 +1,56 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+// Kinds of the operations of a merge, in the order they are executed
+#define OP_MKDIR   'd'  // Create a directory
+#define OP_COPY    'c'  // Create a file and copy its contents. The first name of a hardlinked file is copied too
+#define OP_LINK    'h'  // Link another name of a hardlinked file to the copy of its first name
+#define OP_SYMLINK 's'  // Create a symlink with the same target
+#define OP_KINDS   4
+
+#include <stdio.h>          // FILE
+#include <sys/types.h>      // dev_t etc.
+
+#include "cat_manager.h"    // VerdictTable
+#include "wrapper.h"        // ArrayWrapper
+
+// Operation that creates a single entry of hierarchyC from an entry of A or B
+typedef struct {
+    dev_t device;           // Device and inode of the source, which copies are ordered by
+    ino_t inode;
+    char *target;           // relativeToHier of the copy that a link points to. NULL for the other kinds
+    int position;           // Position of the source in the columns of its hierarchy
+    int level;              // Level of the source, so that every directory is created before its children
+    char kind;              // Uses #defines listed above
+    char fromHierarchy;     // Hierarchy of the source. Uses #defines of entry_manager.h
+} Operation;
+
+// Every operation of a merge, decided before any of them is executed
+// NOTE: The operations are sorted in the order they are executed. Directories come first, level by level.
+// Copies come next, ordered by the device and the inode of their sources, which lie in about the same order
+// on the device, so the sources are read mostly sequentially instead of in the order they were matched.
+// Links and symlinks come last, once every file they may refer to exists
+typedef struct {
+    ArrayWrapper *wrapperA;
+    ArrayWrapper *wrapperB;
+    Operation *ops;
+    int count;
+    unsigned long kindCounts[OP_KINDS];     // Operations of every kind, in the order listed above
+    unsigned long bytes;                    // Bytes of the files that are copied
+} MergePlan;
+
+// Decide the operations that merge 2 catalogs, whose pairs are given by 'table'. Of every pair, the newest
+// entry is kept, and B's when both have the same modification time. Entries whose parent ends up not being
+// a directory in hierarchyC are left out, and so are their children. Both catalogs must have stat'ed their directories
+MergePlan *plan_create(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB, VerdictTable *table);
+
+// Print the number of operations of every kind, and the bytes that they copy
+void plan_report(MergePlan *plan, FILE *stream);
+
+// Execute every operation of a plan, creating hierarchyC
+void plan_execute(MergePlan *plan);
+
+// Destroy a plan using appropriate memory deallocation
+void plan_destroy(MergePlan *plan);
+
+#endif
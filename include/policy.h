@@ -0,0 +1,56 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdio.h>          // FILE
+
+#include "wrapper.h"        // ArrayWrapper
+
+// Tiers of the comparison policy, from the cheapest to the most expensive one. Every tier
+// either decides the verdict of a pair of same-name entries or leaves it to the next tiers
+#define TIER_TREE    0      // Both entries lie below a pair of directories whose subtrees have the same digest
+#define TIER_INODE   1      // Both entries are the same file (same device and inode)
+#define TIER_SIZE    2      // Files of different sizes differ, and empty files are the same
+#define TIER_MTIME   3      // Files of the same size and modification time (in nanoseconds) are trusted to be the same
+#define TIER_CACHE   4      // Both files have a known signature, in the signature cache or in a manifest
+#define TIER_SAMPLE  5      // The first or the last bytes of the files differ
+#define TIER_FULL    6      // The whole contents of the files are compared
+#define TIER_SYMLINK 7      // Symlinks are compared by the files they point to
+#define TIER_COUNT   8
+
+// Bit of a tier in the set of tiers that the user enabled
+#define TIER_BIT(tier) (1u << (tier))
+// Tiers that can be turned on and off from the command line. The rest are always used
+#define TIER_OPTIONAL (TIER_BIT(TIER_INODE) | TIER_BIT(TIER_MTIME) | TIER_BIT(TIER_SAMPLE))
+// Tiers used unless the user chooses otherwise. None of them can give a wrong verdict
+#define TIER_DEFAULT (TIER_BIT(TIER_INODE) | TIER_BIT(TIER_SAMPLE))
+
+// Parses a comma separated list of names of optional tiers (inode, mtime, sample).
+// Returns the set of given tiers, or 0 if the list is not valid
+unsigned int policy_parse(char *list);
+
+// Returns true if the same-name directories i of catalog A and j of catalog B have the same digest, in which
+// case every entry below them has a same entry below the other directory, and the subtrees need no comparison
+int policy_subtrees_same(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j);
+
+// Decides the verdict of entry i of a catalog, which lies below a pair of directories with the same digest
+char policy_tree_verdict(ArrayWrapper *wrapper, int i);
+
+// Decides the verdict of entry i of catalog A and its same-name entry j of catalog B from their
+// metadata alone. Returns PENDING if their contents have to be compared
+char policy_metadata_verdict(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j);
+
+// Decides the verdict of a pair left PENDING above, by reading the entries. Safe to call from multiple threads
+char policy_contents_verdict(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j);
+
+// Decides the verdict of a pair of same-name entries that are not in a catalog, through every tier
+char policy_entries_verdict(EntryInfo *entryA, EntryInfo *entryB);
+
+// Same as above, for entries that may be removed while they are compared. Returns VANISHED if either entry,
+// or the target of either symlink, no longer exists by the time it is read
+char policy_live_verdict(EntryInfo *entryA, EntryInfo *entryB);
+
+// Prints how many pairs, and how many bytes of files, every tier decided. If 'json' is true,
+// prints them as a JSON object keyed by the names of the tiers, without a newline
+void policy_report(FILE *stream, int json);
+
+#endif
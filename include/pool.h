@@ -0,0 +1,22 @@
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct thread_pool ThreadPool;
+
+// Initializes and returns a pool of given number of worker threads
+ThreadPool *pool_create(int threads);
+
+// Schedules function(arg) to run on a worker. Tasks submitted from inside a worker are
+// queued on that worker's own deque. Idle workers steal from the other deques
+void pool_submit(ThreadPool *pool, void (*function)(void *), void *arg);
+
+// Blocks until every submitted task, including the ones submitted by tasks, has finished
+void pool_wait(ThreadPool *pool);
+
+// Returns the id (0 to threads-1) of the calling worker, or -1 if not called by a worker
+int pool_worker_id(void);
+
+// Destroys given pool. Queued tasks are not run
+void pool_destroy(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "arena.h"          // Arena
+#include "entry_manager.h"  // EntryInfo
+#include "pool.h"           // ThreadPool
+
+typedef struct dir_scan DirScan;
+
+// Result of scanning a single directory
+struct dir_scan {
+    char *path;             // Relative path of the scanned directory
+    int fd;                 // Descriptor of the directory, if it was opened by the scan of its parent. Otherwise -1
+    char fromHierarchy;     // Indicates from which hierarchy this directory comes from
+    ThreadPool *pool;       // Pool that scans this directory and its subdirectories
+    Arena **arenas;         // One arena per worker of the pool. Entries are allocated in the arena of the worker that scans them
+
+    EntryInfo **entries;    // Entries of the directory, in the order they were read
+    int count;
+    int capacity;
+
+    DirScan **subdirs;      // Scans of the subdirectories, in the same order as their entries
+    int subdirCount;
+    int subdirCapacity;
+};
+
+// Prepare the scanner for a pool of given number of workers. Sets up the io_uring
+// backend if it was selected. If io_uring is not available, the scanner falls back to getdents
+void scanner_init(int workers);
+
+// Returns true if the scan stats the directories of given hierarchy. When only comparing, a directory is matched
+// by its type and name alone, so it is not stat'ed, and every other field of its entry is left zero. Directories
+// are still stat'ed when merging, or when the scan is saved to a manifest
+int scanner_stats_directories(char fromHierarchy);
+
+// Release everything that scanner_init() allocated
+void scanner_destroy(void);
+
+// Schedules the scan of given directory on given pool. Every subdirectory found is
+// scanned by a task of its own. The result is complete once pool_wait() returns
+DirScan *scan_directory(ThreadPool *pool, Arena **arenas, char *path, char fromHierarchy);
+
+// Destroy a scan and the scans of its subdirectories. The entries are not destroyed
+void scan_destroy(DirScan *scan);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t etc.
+
+#define SHA256_LEN 32   // Length of a digest in bytes
+
+// State of a SHA-256 computation
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            // Bytes hashed so far
+    unsigned char block[64];    // Bytes that don't fill a whole block yet
+    size_t blockLen;
+} Sha256;
+
+// Start a new SHA-256 computation
+void sha256_init(Sha256 *sha);
+
+// Hash 'len' more bytes of the message
+void sha256_update(Sha256 *sha, const void *data, size_t len);
+
+// Finish the computation and store the digest of the message in 'digest'
+void sha256_final(Sha256 *sha, unsigned char digest[SHA256_LEN]);
+
+#endif
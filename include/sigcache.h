@@ -0,0 +1,29 @@
+#ifndef SIGCACHE_H
+#define SIGCACHE_H
+
+#include "entry_manager.h"  // EntryInfo
+#include "sha256.h"         // SHA256_LEN
+
+typedef struct sig_cache SigCache;
+
+// Opens the signature cache stored in file 'path'. A missing or invalid file gives an empty cache
+// NOTE: The file is a sorted array of records, each one holding the SHA-256 of the contents of a
+// regular file, keyed on its device, inode, size and modification time (in nanoseconds). It is
+// mapped to memory and searched in place, so opening it costs the same regardless of its size
+SigCache *cache_open(char *path);
+
+// If the cache has a record with the key of given regular file, stores its content signature
+// in 'digest' and returns true. Returns false otherwise
+int cache_lookup(SigCache *cache, EntryInfo *entry, unsigned char digest[SHA256_LEN]);
+
+// Reads and hashes given regular file, whose file descriptor is 'fd', from its start. Stores its
+// content signature in 'digest' and in the cache. Both functions are safe to call from multiple threads
+void cache_digest(SigCache *cache, EntryInfo *entry, int fd, unsigned char digest[SHA256_LEN]);
+
+// Writes the new signatures back to the file of the cache, and destroys the cache
+// NOTE: Concurrent runs may share a cache file. The records are merged with the latest contents of
+// the file under an exclusive lock, and the new file replaces the old one through an atomic rename(),
+// so every reader sees either the old or the new file, in whole
+void cache_close(SigCache *cache);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef STATS_H
+#define STATS_H
+
+#define STATS_NONE 0        // No statistics are printed
+#define STATS_TEXT 't'      // A table per kind of statistic
+#define STATS_JSON 'j'      // A single JSON object
+
+// Phases of a run, in the order they happen. Every moment of a run belongs to a single phase
+#define PHASE_SETUP    0    // Parsing the options, and loading the signature cache
+#define PHASE_SCAN     1    // Scanning both hierarchies, or loading their manifests
+#define PHASE_COMPARE  2    // Deciding the verdict of every pair, including reading the contents of files
+#define PHASE_PRINT    3    // Writing the differences
+#define PHASE_PLAN     4    // Deciding the operations that create hierarchyC
+#define PHASE_MERGE    5    // Creating hierarchyC
+#define PHASE_WALK     6    // Walking both hierarchies in lockstep (--stream), which compares, prints and merges at once
+#define PHASE_WATCH    7    // Following the changes of both hierarchies (--watch)
+#define PHASE_CLEANUP  8    // Saving the signature cache, and freeing everything
+#define PHASE_COUNT    9
+
+// Counters of a run
+#define COUNT_ENTRIES_A 0   // Entries of hierarchyA made from a stat
+#define COUNT_ENTRIES_B 1   // Entries of hierarchyB made from a stat
+#define COUNT_PAIRS     2   // Pairs of same-name entries whose verdict was decided
+#define COUNT_AVOIDED   3   // Pairs of files decided without reading either of them
+#define COUNT_READ      4   // Bytes of files read to compare them, or to compute their signatures
+#define COUNT_WRITTEN   5   // Bytes of files copied to hierarchyC
+#define COUNT_LINKED    6   // Hardlinks and symlinks created in hierarchyC
+#define COUNT_LSTAT     7   // Entries stat'ed, without following symlinks (lstat(), fstatat() or statx())
+#define COUNT_REALPATH  8   // Calls of realpath()
+#define COUNT_OPEN      9   // Files and directories of the hierarchies opened, directly or through io_uring
+#define COUNT_COUNT     10
+
+#include <stdio.h>          // FILE
+
+// Starts timing the first phase. Called once, before any other function below
+void stats_init(void);
+
+// Ends the phase in progress and starts given one. Only called by the main thread
+void stats_phase(int phase);
+
+// Adds 'n' to given counter. Safe to call from multiple threads
+// NOTE: Every thread adds to counters of its own, so counting costs a few instructions and never
+// contends with other threads. The counters of a thread are added to the totals once it exits
+void stats_count(int counter, unsigned long n);
+
+// Ends the phase in progress, and prints the time spent in every phase, every counter and the peak
+// resident memory, followed by the reports of the comparison policy and, if 'merged' is true, of the
+// copies. 'format' is one of the #defines listed above
+void stats_report(FILE *stream, char format, int merged);
+
+// Frees the counters of the threads that are still running
+void stats_destroy(void);
+
+#endif
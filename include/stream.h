@@ -0,0 +1,12 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// Walks hierarchyA and hierarchyB in lockstep, one pair of same-name directories at a time, with the
+// children of every directory sorted by name. Prints the differences of every pair, and merges it in
+// hierarchyC if the user wants to, as soon as the pair is resolved
+// NOTE: Only the listings of the directories on the current path of the walk are kept in memory, so
+// memory grows with the depth and the width of the hierarchies instead of their number of entries.
+// The same lines as find_differences() are printed, but in the order of the walk and without headers
+void stream_walk(void);
+
+#endif
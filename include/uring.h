@@ -0,0 +1,45 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h> // struct io_uring_sqe etc.
+
+typedef struct uring Uring;
+
+// Initializes and returns an io_uring instance with given number of submission entries.
+// Returns NULL (with errno set) if io_uring is not available
+Uring *uring_create(unsigned int entries);
+
+// Returns a cleared submission entry, or NULL if the submission queue is full
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+
+// Submits every prepared submission entry and waits for at least 'waitNr' completions
+void uring_submit(Uring *ring, unsigned int waitNr);
+
+// Copies the oldest completion to 'cqe' and removes it from the completion queue.
+// If 'wait' is true, blocks until a completion is available. Otherwise returns false if none is
+int uring_get_cqe(Uring *ring, struct io_uring_cqe *cqe, int wait);
+
+// Returns how many submission entries can still be prepared before the submission queue is full
+unsigned int uring_sq_space(Uring *ring);
+
+// Returns true if the kernel supports every one of the 'count' given opcodes (IORING_OP_*). Returns false
+// if it lacks any of them, or can't tell (kernels before 5.6, which also lack most opcodes)
+// NOTE: A kernel that lacks an opcode still accepts its requests, and fails every one of them with
+// -EINVAL, so the opcodes that a backend needs are checked before it is chosen
+int uring_supports(Uring *ring, const unsigned char *opcodes, int count);
+
+// Registers a table of 'count' empty file slots, that requests can open files into and then use
+// through IOSQE_FIXED_FILE. Returns -1 (with errno set) if the kernel does not support it
+int uring_register_files(Uring *ring, unsigned int count);
+
+// Returns true if a request can open a file into a slot of the table registered above, instead of getting a
+// descriptor. Kernels before 5.15 ignore the slot, and open a descriptor that no request would ever close
+int uring_supports_direct_open(Uring *ring);
+
+// Closes the file left open in given slot of the table, if any
+void uring_release_file(Uring *ring, unsigned int slot);
+
+// Destroys given io_uring instance
+void uring_destroy(Uring *ring);
+
+#endif
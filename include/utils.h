@@ -27,7 +27,13 @@ char *concatinate(char *currentPath, char *entryName);
 // Return the absolute path of a given path
 char *get_absolute_path(char *from, char *relative);
 
+// Return the path of the absolute path 'to' in relation to the absolute directory 'from'
+char *relative_path(char *from, char *to);
+
 // Paths start with ./ and end with /
 char *fix_path(char *path);
 
+// Return the 64-bit FNV-1a hash of a given string
+unsigned long hash_string(char *string);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "wrapper.h"        // ArrayWrapper
+
+// Prints the differences of both catalogs as find_differences() does, then keeps running and follows the
+// changes of both hierarchies through inotify. Every change is printed as soon as it is seen, either as an
+// entry that became a difference (output_added()) or as one that stopped being one (output_resolved()).
+// Returns once the process gets SIGINT or SIGTERM
+// NOTE: Only the pairs of the touched paths are compared again. A created, removed or moved directory
+// has its whole subtree compared again, in both hierarchies. The kernel drops events when its queue
+// overflows, without telling which directories they were for, so an overflow compares both hierarchies again
+void watch_run(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB);
+
+#endif
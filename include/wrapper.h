@@ -1,22 +1,63 @@
 #ifndef WRAPPER_H
 #define WRAPPER_H
 
+#include <sys/types.h>      // off_t etc.
+
 #include "entry_manager.h"  // EntryInfo
+#include "hashindex.h"      // HashIndex
+#include "sha256.h"         // SHA256_LEN
 
-// Wrapper used to save information about the array of entries
+// Wrapper used to save information about the entries of a hierarchy
+// NOTE: The entries are stored column by column: position i of every column below refers to
+// entry i. The loops that match and filter the entries of 2 hierarchies only touch the columns
+// they need, so they walk densely packed memory instead of chasing a pointer per entry
 typedef struct {
-    int index;          // Current index of array
-    int size;           // Total size of array
-    EntryInfo **array;  // The array of EntryInfo pointers
-    int *levels;        // Array in which position i refers to the start of level-i in above array
-    int lastLevel;      // Last level of array
-    char fromHierarchy; // Indicates from which hierarchy this array comes from. Uses #defines listed above
+    int index;              // Current index of the columns
+    int size;               // Total size of the columns
+    char *types;            // File type of every entry. Uses #defines of entry_manager.h
+    off_t *sizes;           // Size of every entry
+    time_t *mtimes;         // Modification time of every entry
+    long *mtimeNsecs;       // Nanoseconds of the modification time of every entry
+    dev_t *devices;         // Id of the device that holds every entry
+    ino_t *inodes;          // Inode id of every entry
+    nlink_t *links;         // Number of names of the inode of every entry
+    mode_t *perms;          // Permissions of every entry
+    unsigned long *hashes;  // Hash of the relativeToHier of every entry
+    size_t *paths;          // Offset of the relativeToHier of every entry in the string pool
+    unsigned short *names;  // Offset of the name of every entry in its relativeToHier
+    int *parents;           // Position of the directory of every entry in above columns. -1 for the entries of the root
+    char *strings;          // String pool. Holds the relativePath of every entry, one after the other
+    size_t stringsLen;      // Used bytes of the string pool
+    int rootLen;            // Length of the part of every relativePath that precedes relativeToHier
+    int *levels;            // Array in which position i refers to the start of level-i in above columns
+    int lastLevel;          // Last level of the columns
+    HashIndex **indexes;    // Array in which position i refers to the hash index of level-i, keyed on relativeToHier
+    char fromHierarchy;     // Indicates from which hierarchy this wrapper comes from. Uses #defines of entry_manager.h
+    int directoryStats;     // Whether the directories were stat'ed. Otherwise only their type and name are known (see scanner.h)
+    unsigned char (*digests)[SHA256_LEN];   // Content signature of every file, and digest of the subtree of every directory. NULL if none is known
+    char *digestsKnown;     // Whether the above signature of every entry is known. NULL along with the signatures
+    void *map;              // Mapping of the manifest that the columns were loaded from. NULL if they were scanned
+    size_t mapLen;
 } ArrayWrapper;
 
-// Initialize a wrapper
-ArrayWrapper *wrapper_init(char *path, char fromHierarchy);
+// Initialize the wrappers of both hierarchies. Both hierarchies are scanned concurrently, except
+// for a hierarchy whose manifest was given (--manifest-a, --manifest-b), which is loaded from it
+void wrappers_init(char *pathA, char *pathB, ArrayWrapper **wrapperA, ArrayWrapper **wrapperB);
+
+// Fill 'entry' with the fields of the entry in position i. Its paths point inside the string pool
+void wrapper_entry(ArrayWrapper *wrapper, int i, EntryInfo *entry);
+
+// Returns the relativeToHier of the entry in position i
+char *wrapper_path(ArrayWrapper *wrapper, int i);
+
+// Returns the content signature of the file in position i, or the digest of the subtree of the directory in
+// position i, or NULL if it is not known
+// NOTE: The digest of a directory is built bottom-up from the names, types, sizes and signatures of its
+// entries. It is only known if the signatures of every file below it are known, and no symlink lies below it,
+// so 2 directories with the same digest have the same entries below them, with the same contents
+unsigned char *wrapper_digest(ArrayWrapper *wrapper, int i);
 
 // Destroy a wrapper using appropriate memory deallocation
 void wrapper_destroy(ArrayWrapper *wrapper);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,61 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc() etc.
+
+#include "arena.h"
+#include "utils.h"      // NULL_CHECK()
+
+// Alignment of every allocation
+#define ARENA_ALIGN 8
+
+typedef struct chunk Chunk;
+struct chunk {
+    Chunk *next;        // Previously filled chunk
+    size_t size;        // Usable bytes of the chunk
+    size_t used;        // Bytes handed out so far
+    char *data;
+};
+
+struct arena {
+    Chunk *current;     // Chunk that allocations are made from. Older chunks are linked behind it
+    size_t chunkSize;
+};
+
+// Reserve a new chunk that fits at least 'size' bytes and make it the current one
+static void arena_grow(Arena *arena, size_t size) {
+    size_t chunkSize = (size > arena->chunkSize) ? size : arena->chunkSize;
+    // The header of the chunk and its data are a single allocation
+    Chunk *chunk = malloc(sizeof(*chunk) + chunkSize);
+    NULL_CHECK(chunk, "malloc");
+    chunk->size = chunkSize;
+    chunk->used = 0;
+    chunk->data = (char *)(chunk + 1);
+    chunk->next = arena->current;
+    arena->current = chunk;
+}
+
+Arena *arena_create(size_t chunkSize) {
+    Arena *arena = malloc(sizeof(*arena));
+    NULL_CHECK(arena, "malloc");
+    arena->current = NULL;
+    arena->chunkSize = chunkSize;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (arena->current == NULL || arena->current->size - arena->current->used < size) arena_grow(arena, size);
+
+    void *memory = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    return memory;
+}
+
+void arena_destroy(Arena *arena) {
+    Chunk *chunk = arena->current;
+    while (chunk != NULL) {
+        Chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
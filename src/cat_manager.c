@@ -1,100 +1,268 @@
 #include <dirent.h>         // DIR etc.
+#include <pthread.h>        // pthread_mutex_t etc.
 #include <stdio.h>          // perror() etc.
 #include <stdlib.h>         // EXIT_FAILURE
-#include <string.h>         // strlen() etc.
 
 #include "cat_manager.h"
 #include "info.h"           // GlobalInfo
+#include "output.h"         // output_difference() etc.
+#include "plan.h"           // MergePlan
+#include "policy.h"         // policy_metadata_verdict() etc.
+#include "pool.h"           // ThreadPool
+#include "stats.h"          // stats_phase()
+#include "utils.h"          // NULL_CHECK()
 
 extern GlobalInfo *info;
 
-// Find and print the differences between two catalogs
-void find_differences(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB) {
-    // Look for differences only in the common hierarchy-levels of the catalogs, since the 
+// Most pairs that a worker compares in one task
+#define BATCH_PAIRS 64
+// Most bytes that a worker reads in one task, unless a single pair is larger
+#define BATCH_BYTES (4 * 1024 * 1024)
+
+// Same-name pairs whose contents are compared by a worker, in a single task
+typedef struct comparer Comparer;
+typedef struct {
+    Comparer *comparer;
+    int count;                  // Number of pairs
+    size_t bytes;               // Bytes of the files of all pairs
+    int pairsA[BATCH_PAIRS];    // Positions of the pairs in catalog A
+    int pairsB[BATCH_PAIRS];    // Positions of the pairs in catalog B
+} Batch;
+
+// Hands the pairs that need their contents compared to a pool of workers
+// NOTE: The matching loop only queues the pairs, so many files are read at once. The number of
+// bytes that the queued and running batches may read is bounded, so a fast matching loop can't
+// pile up more work (and open files) than the devices can take
+struct comparer {
+    ArrayWrapper *wrapperA;
+    ArrayWrapper *wrapperB;
+    VerdictTable *table;
+    ThreadPool *pool;
+    Batch *batch;               // Batch being filled. NULL if empty
+
+    pthread_mutex_t lock;       // Protects the counter below
+    pthread_cond_t released;    // Signaled when a batch finishes
+    size_t inFlight;            // Bytes of the batches submitted but not finished yet
+    size_t maxInFlight;         // Limit of above bytes
+};
+
+// Task of a worker: Compare every pair of a batch
+// NOTE: Every pair has its own positions in the verdict arrays, so workers never write to the same position
+static void batch_compare(void *arg) {
+    Batch *batch = arg;
+    Comparer *comparer = batch->comparer;
+    for (int k = 0; k < batch->count; k++) {
+        int i = batch->pairsA[k], j = batch->pairsB[k];
+        char verdict = policy_contents_verdict(comparer->wrapperA, i, comparer->wrapperB, j);
+        comparer->table->verdictsA[i] = verdict;
+        comparer->table->verdictsB[j] = verdict;
+    }
+
+    pthread_mutex_lock(&comparer->lock);
+    comparer->inFlight -= batch->bytes;
+    pthread_cond_signal(&comparer->released);
+    pthread_mutex_unlock(&comparer->lock);
+    free(batch);
+}
+
+// Submit the batch being filled to the workers, once the bytes it reads fit in the limit
+// NOTE: A batch is always let through when nothing else is in flight, so a pair larger than the limit can't block forever
+static void comparer_flush(Comparer *comparer) {
+    Batch *batch = comparer->batch;
+    if (batch == NULL) return;
+    comparer->batch = NULL;
+
+    pthread_mutex_lock(&comparer->lock);
+    while (comparer->inFlight > 0 && comparer->inFlight + batch->bytes > comparer->maxInFlight) {
+        pthread_cond_wait(&comparer->released, &comparer->lock);
+    }
+    comparer->inFlight += batch->bytes;
+    pthread_mutex_unlock(&comparer->lock);
+    pool_submit(comparer->pool, batch_compare, batch);
+}
+
+// Queue the pair of entry i of catalog A and entry j of catalog B to have their contents compared
+static void comparer_add(Comparer *comparer, int i, int j) {
+    if (comparer->batch == NULL) {
+        comparer->batch = malloc(sizeof(*comparer->batch));
+        NULL_CHECK(comparer->batch, "malloc");
+        comparer->batch->comparer = comparer;
+        comparer->batch->count = 0;
+        comparer->batch->bytes = 0;
+    }
+    Batch *batch = comparer->batch;
+    batch->pairsA[batch->count] = i;
+    batch->pairsB[batch->count] = j;
+    batch->count++;
+    // Both files of the pair are read. Symlinks are never read
+    if (comparer->wrapperA->types[i] != SYMLINK) batch->bytes += 2 * comparer->wrapperA->sizes[i];
+    if (batch->count == BATCH_PAIRS || batch->bytes >= BATCH_BYTES) comparer_flush(comparer);
+}
+
+// Match the entries of 2 catalogs and compare every matched pair once
+VerdictTable *verdicts_init(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB) {
+    VerdictTable *table = malloc(sizeof(*table));
+    NULL_CHECK(table, "malloc");
+    // One extra position is allocated, so that an empty catalog still gets a valid array
+    table->partnersA = malloc((wrapperA->size + 1) * sizeof(*table->partnersA));
+    NULL_CHECK(table->partnersA, "malloc");
+    table->partnersB = malloc((wrapperB->size + 1) * sizeof(*table->partnersB));
+    NULL_CHECK(table->partnersB, "malloc");
+    table->verdictsA = malloc((wrapperA->size + 1) * sizeof(*table->verdictsA));
+    NULL_CHECK(table->verdictsA, "malloc");
+    table->verdictsB = malloc((wrapperB->size + 1) * sizeof(*table->verdictsB));
+    NULL_CHECK(table->verdictsB, "malloc");
+
+    // Every entry is unique until it is matched with an entry of the other catalog
+    for (int i = 0; i < wrapperA->size; i++) {
+        table->partnersA[i] = -1;
+        table->verdictsA[i] = MISSING;
+    }
+    for (int j = 0; j < wrapperB->size; j++) {
+        table->partnersB[j] = -1;
+        table->verdictsB[j] = MISSING;
+    }
+
+    Comparer comparer = {
+        .wrapperA = wrapperA,
+        .wrapperB = wrapperB,
+        .table = table,
+        .pool = pool_create(info->options.compareThreads),
+        .batch = NULL,
+        .inFlight = 0,
+        .maxInFlight = info->options.maxInFlight
+    };
+    pthread_mutex_init(&comparer.lock, NULL);
+    pthread_cond_init(&comparer.released, NULL);
+
+    // Entries of both catalogs that lie in (or are the root of) a subtree with the same digest in the other
+    // catalog. Every entry below them is the same, so it is neither looked up nor compared. Only the merge
+    // still looks them up, as it needs the partner of every entry
+    char *prunedA = calloc(wrapperA->size + 1, sizeof(*prunedA));
+    NULL_CHECK(prunedA, "calloc");
+    char *prunedB = calloc(wrapperB->size + 1, sizeof(*prunedB));
+    NULL_CHECK(prunedB, "calloc");
+    int merging = (info->options.pathC != NULL);
+
+    // Look for pairs only in the common hierarchy-levels of the catalogs, since the 
     // uncommmon ones (one catalog has more levels than the other) are unique
     int commonLevels = (wrapperA->lastLevel < wrapperB->lastLevel) ? wrapperA->lastLevel : wrapperB->lastLevel;
     for (int level = 0; level <= commonLevels; level++) {
-        // Traverse the entries of hierarchyA in current level and compare them to the ones of hierarchyB
         for (int i = wrapperA->levels[level]; i < wrapperA->levels[level+1]; i++) {
-            // Flag to check if the current entry is the same with another entry in hierarchyB
-            int same = 0;
-            for (int j = wrapperB->levels[level]; j < wrapperB->levels[level+1]; j++) {
-                // If entries have either different types OR names, continue
-                if (wrapperA->array[i]->fileType != wrapperB->array[j]->fileType) continue;
-                if (strcmp(wrapperA->array[i]->relativeToHier, wrapperB->array[j]->relativeToHier)) continue;
-
-                same = entries_are_same(wrapperA->array[i], wrapperB->array[j]);
+            int pruned = (wrapperA->parents[i] != -1 && prunedA[wrapperA->parents[i]]);
+            // Look up the entry of hierarchyB with the same name in the index of current level
+            int j = (!pruned || merging) ? hash_index_find(wrapperB->indexes[level], wrapperA->hashes[i], wrapper_path(wrapperA, i)) : -1;
+            if (pruned) {
+                prunedA[i] = 1;
+                table->verdictsA[i] = policy_tree_verdict(wrapperA, i);
+                if (j != -1) {
+                    table->partnersA[i] = j;
+                    table->partnersB[j] = i;
+                }
+                continue;
+            }
+            if (j == -1) continue;
+            table->partnersA[i] = j;
+            table->partnersB[j] = i;
 
-                // No need to keep searching further
-                break;
+            // Decide from the columns whenever possible, and leave the
+            // pairs whose contents have to be compared to the workers
+            char verdict = policy_metadata_verdict(wrapperA, i, wrapperB, j);
+            table->verdictsA[i] = verdict;
+            table->verdictsB[j] = verdict;
+            if (verdict == PENDING) comparer_add(&comparer, i, j);
+            else if (verdict == SAME && wrapperA->types[i] == DIRECTORY && policy_subtrees_same(wrapperA, i, wrapperB, j)) {
+                prunedA[i] = 1;
+                prunedB[j] = 1;
             }
-            // If no other same entry was found, print the difference
-            if (!same) printf("\t%s\n", wrapperA->array[i]->relativePath);
         }
-    }
-    // Mark each entry of each extra-level of hierarchyA as a difference
-    for (int level = commonLevels + 1; level <= wrapperA->lastLevel; level++) {
-        for (int i = wrapperA->levels[level]; i < wrapperA->levels[level+1]; i++) {
-            printf("\t%s\n", wrapperA->array[i]->relativePath);
+        // The entries of B below a pruned directory are the same as their partners
+        for (int j = wrapperB->levels[level]; j < wrapperB->levels[level+1]; j++) {
+            if (wrapperB->parents[j] == -1 || !prunedB[wrapperB->parents[j]]) continue;
+            prunedB[j] = 1;
+            table->verdictsB[j] = SAME;
         }
     }
+    free(prunedA);
+    free(prunedB);
+
+    // Every verdict is known once the workers are done
+    comparer_flush(&comparer);
+    pool_wait(comparer.pool);
+    pool_destroy(comparer.pool);
+    pthread_mutex_destroy(&comparer.lock);
+    pthread_cond_destroy(&comparer.released);
+    return table;
+}
+
+// Destroy a verdict table using appropriate memory deallocation
+void verdicts_destroy(VerdictTable *table) {
+    free(table->partnersA);
+    free(table->partnersB);
+    free(table->verdictsA);
+    free(table->verdictsB);
+    free(table);
+}
+
+// Print every entry of a catalog that has no same entry in the other catalog, whose partners are 'partners'
+static void print_differences(ArrayWrapper *wrapper, char *verdicts, int *partners, ArrayWrapper *other) {
+    output_header(wrapper->fromHierarchy);
+    for (int i = 0; i < wrapper->size; i++) {
+        if (verdicts[i] == SAME) continue;
+        EntryInfo entry, partner;
+        wrapper_entry(wrapper, i, &entry);
+        if (partners[i] != -1) wrapper_entry(other, partners[i], &partner);
+        output_difference(&entry, (partners[i] != -1) ? &partner : NULL, verdicts[i]);
+    }
+}
+
+// Find and print the differences between two catalogs
+void find_differences(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB) {
+    stats_phase(PHASE_COMPARE);
+    VerdictTable *table = verdicts_init(wrapperA, wrapperB);
+    stats_phase(PHASE_PRINT);
+    print_differences(wrapperA, table->verdictsA, table->partnersA, wrapperB);
+    print_differences(wrapperB, table->verdictsB, table->partnersB, wrapperA);
+    verdicts_destroy(table);
 }
 
 // Find and print the differences between two catalogs. Also merge them in a new catalog
 void find_and_merge(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB) {
-    // Open dirC
-    DIR *dirC = opendir(info->hierarchyC);
-    if (dirC == NULL) {
-        perror("opendir()");
+    // The merge creates directories with their permissions, and orders copies by their devices and inodes
+    if (!wrapperA->directoryStats || !wrapperB->directoryStats) {
+        fprintf(stderr, "The directories of %s were not stat'ed, so they can't be merged\n",
+                !wrapperA->directoryStats ? info->options.pathA : info->options.pathB);
         exit(EXIT_FAILURE);
     }
-    // Look for differences only in the common hierarchy-levels of the catalogs, since the 
-    // uncommmon ones (one catalog has more levels than the other) are unique and should be merged
-    int commonLevels = (wrapperA->lastLevel < wrapperB->lastLevel) ? wrapperA->lastLevel : wrapperB->lastLevel;
-    for (int level = 0; level <= commonLevels; level++) {
-        // Traverse the entries of hierarchyA in current level and compare them to the ones of hierarchyB
-        for (int i = wrapperA->levels[level]; i < wrapperA->levels[level+1]; i++) {
-            // Flags to check if entryA was found/merged or if another entry was already created
-            int same = 0, merged = 0, created = 0;
-            for (int j = wrapperB->levels[level]; j < wrapperB->levels[level+1]; j++) {
-                // If the 2 entries have a different name, ignore them
-                if (strcmp(wrapperA->array[i]->relativeToHier, wrapperB->array[j]->relativeToHier)) continue;
-
-                // If 2 entries have the same name and B's entry is newer OR A and B have the
-                // same modified time, keep B. Update the flag so A won't also get merged
-                if (wrapperA->array[i]->mtime <= wrapperB->array[j]->mtime) {
-                    create_entry(wrapperB->array[j]);
-                    created = 1;
-                }
-                // Else if A was a newer directory, create it so you can also create future children
-                else if (wrapperA->array[i]->fileType == DIRECTORY) {
-                    create_entry(wrapperA->array[i]);
-                    created = 1;
-                }
-                merged = 1;
 
-                // If the 2 entries have different types, then there is no need to compare them
-                if (wrapperA->array[i]->fileType == wrapperB->array[j]->fileType) {
-                    // Here, the 2 entries have the same name AND file type. Compare them
-                    same = entries_are_same(wrapperA->array[i], wrapperB->array[j]);
-                }
-                break;
-            }
-            // If no other same entry was found, print the difference
-            if (!same) printf("\t%s\n", wrapperA->array[i]->relativePath);
-            // If no other same entry was found and B's entry was not created, create entryA in dirC
-            if (!merged && !created) create_entry(wrapperA->array[i]);
-        }
+    // Open dirC. A dry run never creates it
+    DIR *dirC = NULL;
+    if (!info->options.dryRun && (dirC = opendir(info->hierarchyC)) == NULL) {
+        perror("opendir()");
+        exit(EXIT_FAILURE);
     }
-    // Mark each entry of each extra-level of hierarchyA as a difference and add it to dirC
-    for (int level = commonLevels + 1; level <= wrapperA->lastLevel; level++) {
-        for (int i = wrapperA->levels[level]; i < wrapperA->levels[level+1]; i++) {
-            printf("\t%s\n", wrapperA->array[i]->relativePath);
-            create_entry(wrapperA->array[i]);
-        }
+
+    stats_phase(PHASE_COMPARE);
+    VerdictTable *table = verdicts_init(wrapperA, wrapperB);
+    stats_phase(PHASE_PRINT);
+    print_differences(wrapperA, table->verdictsA, table->partnersA, wrapperB);
+    print_differences(wrapperB, table->verdictsB, table->partnersB, wrapperA);
+    // The differences are known long before the merge is done
+    output_flush();
+
+    // Decide every operation of the merge before executing any of them, so that they run in the order of their sources
+    stats_phase(PHASE_PLAN);
+    MergePlan *plan = plan_create(wrapperA, wrapperB, table);
+    if (info->options.dryRun) plan_report(plan, stderr);
+    else {
+        stats_phase(PHASE_MERGE);
+        plan_execute(plan);
     }
-    if (closedir(dirC) == -1) {
+    plan_destroy(plan);
+
+    verdicts_destroy(table);
+    if (dirC != NULL && closedir(dirC) == -1) {
         perror("closedir()");
         exit(EXIT_FAILURE);
     }
-}
\ No newline at end of file
+}
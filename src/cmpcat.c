@@ -1,69 +1,211 @@
 #include <dirent.h>         // DIR etc.
+#include <getopt.h>         // getopt_long() etc.
 #include <stdio.h>          // printf() etc.
+#include <stdint.h>         // SIZE_MAX
 #include <stdlib.h>         // EXIT_FAILURE
 #include <string.h>         // strlen() etc.
 #include <sys/stat.h>       // mkdir()
 
 #include "cat_manager.h"    // find_differences() etc.
 #include "info.h"           // GlobalInfo
+#include "manifest.h"       // manifest_save()
+#include "output.h"         // output_init() etc.
+#include "policy.h"         // policy_parse() etc.
+#include "stats.h"          // stats_init() etc.
+#include "stream.h"         // stream_walk()
 #include "utils.h"          // fix_path() etc.
+#include "watch.h"          // watch_run()
 #include "wrapper.h"        // ArrayWrapper
 
 GlobalInfo *info; // Global info will be shared among the source files
 
-// Helper function to correctly parse given arguements
-static void parse_args(int argc, char *argv[], char **pathA, char **pathB, char **pathC) {
-    // User can either run the program to only compare OR compare and merge
-    if (argc != 6 && argc != 4) {
-        fprintf(stderr, "Usage: %s -d <pathA> <pathB> OR %s -d <pathA> <pathB> -s <pathC>\n", argv[0], argv[0]);
-        exit(EXIT_FAILURE);
-    }
+// Print how the program should be used and exit
+static void usage(char *exe) {
+    fprintf(stderr, "Usage: %s -d <pathA> <pathB> [-s <pathC>] [-j <threads>] [--scan=readdir|getdents|uring] [--cache=<file>]\n"
+                    "       [--compare-jobs=<threads>] [--max-inflight=<bytes>[K|M|G]] [--tiers=<tier>,...|none] [--stats[=text|json]]\n"
+                    "       [--merge=sync|uring] [--merge-jobs=<threads>] [--dry-run] [--stream]\n"
+                    "       [--manifest-a=<file>] [--manifest-b=<file>] [--save-manifest-a=<file>] [--save-manifest-b=<file>]\n"
+                    "       [--watch] [--format=text|jsonl|nul] [--output-thread]\n", exe);
+    exit(EXIT_FAILURE);
+}
 
-    // Case: User only wants to compare dirs
-    if (argc == 4) {
-        if (strcmp(argv[1], "-d")) {
-            fprintf(stderr, "Usage: %s -d <pathA> <pathB> OR %s -d <pathA> <pathB> -s <pathC>\n", argv[0], argv[0]);
-            exit(EXIT_FAILURE);
-        }
-        *pathA = fix_path(argv[2]);
-        *pathB = fix_path(argv[3]);
-        *pathC = NULL;  // For good measure
-        return;
+// Parse a strictly positive integer given as an option arguement
+static int parse_count(char *exe, char *arg) {
+    char *end;
+    long count = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || count < 1 || count > 1024) {
+        fprintf(stderr, "%s: invalid count '%s'\n", exe, arg);
+        usage(exe);
     }
+    return (int)count;
+}
 
-    // Case: User wants to compare AND merge dirs together
-    if (!strcmp(argv[1], "-d")) {
-        *pathA = fix_path(argv[2]);
-        *pathB = fix_path(argv[3]);
-        if (strcmp(argv[4], "-s")) {
-            fprintf(stderr, "Usage: %s -d <pathA> <pathB> OR %s -d <pathA> <pathB> -s <pathC>\n", argv[0], argv[0]);
-            exit(EXIT_FAILURE);
-        }
-        *pathC = fix_path(argv[5]);
+// Parse a strictly positive size in bytes, optionally followed by a K, M or G multiplier
+static size_t parse_size(char *exe, char *arg) {
+    char *end;
+    unsigned long long size = strtoull(arg, &end, 10);
+    int shift = 0;
+    switch (*end) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
     }
-    else if (!strcmp(argv[1], "-s")) {
-        *pathC = fix_path(argv[2]);
-        if (strcmp(argv[3], "-d")) {
-            fprintf(stderr, "Usage: %s -d <pathA> <pathB> OR %s -d <pathA> <pathB> -s <pathC>\n", argv[0], argv[0]);
-            exit(EXIT_FAILURE);
-        }
-        *pathA = fix_path(argv[4]);
-        *pathB = fix_path(argv[5]);
+    if (*arg < '0' || *arg > '9' || *end != '\0' || size == 0 || size > (SIZE_MAX >> shift)) {
+        fprintf(stderr, "%s: invalid size '%s'\n", exe, arg);
+        usage(exe);
     }
-    else {
-        fprintf(stderr, "Usage: %s -d <pathA> <pathB> OR %s -d <pathA> <pathB> -s <pathC>\n", argv[0], argv[0]);
-        exit(EXIT_FAILURE);
+    return (size_t)size << shift;
+}
+
+// Helper function to correctly parse given arguements
+static void parse_args(int argc, char *argv[], Options *options) {
+    static struct option longOptions[] = {
+        {"jobs", required_argument, NULL, 'j'},
+        {"scan", required_argument, NULL, 'S'},
+        {"merge", required_argument, NULL, 'M'},
+        {"merge-jobs", required_argument, NULL, 'K'},
+        {"dry-run", no_argument, NULL, 'D'},
+        {"cache", required_argument, NULL, 'C'},
+        {"compare-jobs", required_argument, NULL, 'J'},
+        {"max-inflight", required_argument, NULL, 'I'},
+        {"tiers", required_argument, NULL, 'T'},
+        {"stats", optional_argument, NULL, 'X'},
+        {"stream", no_argument, NULL, 'L'},
+        {"watch", no_argument, NULL, 'W'},
+        {"format", required_argument, NULL, 'F'},
+        {"output-thread", no_argument, NULL, 'O'},
+        {"manifest-a", required_argument, NULL, 'a'},
+        {"manifest-b", required_argument, NULL, 'b'},
+        {"save-manifest-a", required_argument, NULL, 'A'},
+        {"save-manifest-b", required_argument, NULL, 'B'},
+        {NULL, 0, NULL, 0}
+    };
+    char *pathA = NULL, *pathC = NULL;
+    options->threads = 1;
+    options->scanBackend = SCAN_GETDENTS;
+    options->mergeBackend = MERGE_SYNC;
+    options->cachePath = NULL;
+    options->manifestA = NULL;
+    options->manifestB = NULL;
+    options->saveManifestA = NULL;
+    options->saveManifestB = NULL;
+    options->compareThreads = 0;
+    options->mergeThreads = 0;
+    options->maxInFlight = 256 * 1024 * 1024;
+    options->tiers = TIER_DEFAULT;
+    options->stats = STATS_NONE;
+    options->stream = 0;
+    options->watch = 0;
+    options->dryRun = 0;
+    options->format = FORMAT_TEXT;
+    options->outputThread = 0;
+
+    // User can either run the program to only compare OR compare and merge
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:s:j:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                pathA = optarg;
+                break;
+            case 's':
+                pathC = optarg;
+                break;
+            case 'j':
+                options->threads = parse_count(argv[0], optarg);
+                break;
+            case 'S':
+                if (!strcmp(optarg, "readdir")) options->scanBackend = SCAN_READDIR;
+                else if (!strcmp(optarg, "getdents")) options->scanBackend = SCAN_GETDENTS;
+                else if (!strcmp(optarg, "uring")) options->scanBackend = SCAN_URING;
+                else usage(argv[0]);
+                break;
+            case 'M':
+                if (!strcmp(optarg, "sync")) options->mergeBackend = MERGE_SYNC;
+                else if (!strcmp(optarg, "uring")) options->mergeBackend = MERGE_URING;
+                else usage(argv[0]);
+                break;
+            case 'K':
+                options->mergeThreads = parse_count(argv[0], optarg);
+                break;
+            case 'D':
+                options->dryRun = 1;
+                break;
+            case 'C':
+                options->cachePath = optarg;
+                break;
+            case 'J':
+                options->compareThreads = parse_count(argv[0], optarg);
+                break;
+            case 'I':
+                options->maxInFlight = parse_size(argv[0], optarg);
+                break;
+            case 'T':
+                if (!strcmp(optarg, "none")) options->tiers = 0;
+                else if ((options->tiers = policy_parse(optarg)) == 0) usage(argv[0]);
+                break;
+            case 'X':
+                if (optarg == NULL || !strcmp(optarg, "text")) options->stats = STATS_TEXT;
+                else if (!strcmp(optarg, "json")) options->stats = STATS_JSON;
+                else usage(argv[0]);
+                break;
+            case 'L':
+                options->stream = 1;
+                break;
+            case 'W':
+                options->watch = 1;
+                break;
+            case 'F':
+                if (!strcmp(optarg, "text")) options->format = FORMAT_TEXT;
+                else if (!strcmp(optarg, "jsonl")) options->format = FORMAT_JSONL;
+                else if (!strcmp(optarg, "nul")) options->format = FORMAT_NUL;
+                else usage(argv[0]);
+                break;
+            case 'O':
+                options->outputThread = 1;
+                break;
+            case 'a':
+                options->manifestA = optarg;
+                break;
+            case 'b':
+                options->manifestB = optarg;
+                break;
+            case 'A':
+                options->saveManifestA = optarg;
+                break;
+            case 'B':
+                options->saveManifestB = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
     }
+    // pathB is the only operand and follows pathA
+    if (pathA == NULL || optind != argc - 1) usage(argv[0]);
+    // Manifests hold whole scans, which the lockstep walk never makes
+    if (options->stream && (options->manifestA != NULL || options->manifestB != NULL ||
+                            options->saveManifestA != NULL || options->saveManifestB != NULL)) usage(argv[0]);
+    // Watching only compares, and needs the catalogs of both hierarchies
+    if (options->watch && (pathC != NULL || options->stream)) usage(argv[0]);
+    // A merge is planned from the catalogs of both hierarchies, which the lockstep walk never makes
+    if (options->dryRun && (pathC == NULL || options->stream)) usage(argv[0]);
+    // Unless told otherwise, compare files and merge with as many threads as the hierarchies are scanned with
+    if (options->compareThreads == 0) options->compareThreads = options->threads;
+    if (options->mergeThreads == 0) options->mergeThreads = options->threads;
+
+    options->pathA = fix_path(pathA);
+    options->pathB = fix_path(argv[optind]);
+    options->pathC = (pathC != NULL) ? fix_path(pathC) : NULL;
+    if (options->pathC == NULL) return;
 
     // If dirC exists, make sure it is empty
     DIR *dirC;
     struct dirent *dirEntryC;
     int n = 0;
-    if ((dirC = opendir(*pathC)) != NULL) {
+    if ((dirC = opendir(options->pathC)) != NULL) {
         // Read all entries. Entries should only be current and parent folder
         while ((dirEntryC = readdir(dirC)) != NULL) {
             if (++n > 2) {
-                fprintf(stderr, "%s is not empty\n", *pathC);
+                fprintf(stderr, "%s is not empty\n", options->pathC);
                 exit(EXIT_FAILURE);
             }
         }
@@ -75,16 +217,17 @@ static void parse_args(int argc, char *argv[], char **pathA, char **pathB, char
 }
 
 int main(int argc, char *argv[]) {
-    char *pathA, *pathB, *pathC;
-    parse_args(argc, argv, &pathA, &pathB, &pathC);
+    stats_init();
+    Options options;
+    parse_args(argc, argv, &options);
 
     DIR *dirA, *dirB, *dirC; 
     // Check if directories exist
-    if ((dirA = opendir(pathA)) == NULL) {
+    if ((dirA = opendir(options.pathA)) == NULL) {
         perror("opendir()");
         exit(EXIT_FAILURE);
     }
-    if ((dirB = opendir(pathB)) == NULL) {
+    if ((dirB = opendir(options.pathB)) == NULL) {
         perror("opendir()");
         exit(EXIT_FAILURE);
     }
@@ -93,9 +236,9 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
     // If user wants to merge, create dirC if it doesn't already exist
-    if (argc == 6 && (dirC = opendir(pathC)) == NULL) {
-        mkdir(pathC, 0755);
-        dirC = opendir(pathC);
+    if (options.pathC != NULL && !options.dryRun && (dirC = opendir(options.pathC)) == NULL) {
+        mkdir(options.pathC, 0755);
+        dirC = opendir(options.pathC);
         if (closedir(dirC) == -1) {
             perror("closedir()");
             exit(EXIT_FAILURE);
@@ -103,39 +246,48 @@ int main(int argc, char *argv[]) {
     }
 
     // Initialize global info
-    info_init(argc, pathA, pathB, pathC);
-
-    // Initialize wrapperA
-    ArrayWrapper *wrapperA = wrapper_init(pathA, HIER_A);
+    info_init(&options);
+    output_init();
 
-    // Initialize wrapperB
-    ArrayWrapper *wrapperB = wrapper_init(pathB, HIER_B);
-
-    // Case: User only wants to find differences
-    if (argc == 4) {
-        printf("In pathA :\n");
-        find_differences(wrapperA, wrapperB);
-        printf("In pathB :\n");
-        find_differences(wrapperB, wrapperA);
+    // Initialize both wrappers, unless the hierarchies are walked in lockstep
+    ArrayWrapper *wrapperA = NULL, *wrapperB = NULL;
+    if (options.stream) {
+        stats_phase(PHASE_WALK);
+        stream_walk();
     }
-    // Case: User want to find differences and merge the dirs
     else {
-        printf("In pathA :\n");
-        find_and_merge(wrapperA, wrapperB);
-        printf("In pathB :\n");
-        find_and_merge(wrapperB, wrapperA);
+        stats_phase(PHASE_SCAN);
+        wrappers_init(info->relativeA, info->relativeB, &wrapperA, &wrapperB);
+        if (options.saveManifestA != NULL) manifest_save(wrapperA, options.saveManifestA);
+        if (options.saveManifestB != NULL) manifest_save(wrapperB, options.saveManifestB);
+
+        // Case: User wants to follow the differences as the hierarchies change
+        if (options.watch) {
+            stats_phase(PHASE_WATCH);
+            watch_run(wrapperA, wrapperB);
+        }
+        // Case: User only wants to find differences
+        else if (options.pathC == NULL) find_differences(wrapperA, wrapperB);
+        // Case: User want to find differences and merge the dirs
+        else find_and_merge(wrapperA, wrapperB);
     }
-    
+    output_destroy();
+    stats_phase(PHASE_CLEANUP);
+
     // Destroy global info
-    info_destroy(argc);
+    info_destroy();
 
     // Destroy the wrappers
-    wrapper_destroy(wrapperA);
-    wrapper_destroy(wrapperB);
+    if (wrapperA != NULL) wrapper_destroy(wrapperA);
+    if (wrapperB != NULL) wrapper_destroy(wrapperB);
+
+    free(options.pathA);
+    free(options.pathB);
+    if (options.pathC != NULL) free(options.pathC);
 
-    free(pathA);
-    free(pathB);
-    if (argc == 6) free(pathC);
+    // The statistics come last, so that they include the time spent above
+    if (options.stats != STATS_NONE) stats_report(stderr, options.stats, options.pathC != NULL && !options.dryRun);
+    stats_destroy();
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,181 @@
+#include <fcntl.h>          // posix_fadvise()
+#include <stdint.h>         // uint64_t
+#include <stdio.h>          // perror()
+#include <stdlib.h>         // exit() etc.
+#include <string.h>         // memcpy()
+#include <sys/mman.h>       // mmap() etc.
+#include <sys/stat.h>       // fstat()
+#include <unistd.h>         // read()
+
+#if defined(__x86_64__)
+#include <immintrin.h>      // _mm256_cmpeq_epi8() etc.
+#endif
+
+#include "compare.h"
+#include "stats.h"          // stats_count()
+
+// Files of at least this size are mapped to memory instead of read in buffers. Below it,
+// the page faults of a fresh mapping cost more than copying the file into buffers
+#define MMAP_MIN (8 * 1024 * 1024)
+// Bytes of a mapping that are compared at once. Pages that have been compared are released
+// right after, so that comparing huge files does not fill the memory of the process
+#define MMAP_WINDOW (32 * 1024 * 1024)
+// Largest buffer a file is read in. Buffers live on the stack, so that every comparison reuses
+// memory that is already mapped and cached, instead of allocating buffers of its own
+#define BUFFER_MAX (64 * 1024)
+
+// Compare 8 bytes at a time. Used where no vector instructions are available
+static size_t first_difference_scalar(const unsigned char *a, const unsigned char *b, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t wordA, wordB;
+        memcpy(&wordA, a + i, 8);
+        memcpy(&wordB, b + i, 8);
+        if (wordA != wordB) break;
+    }
+    for (; i < len; i++) {
+        if (a[i] != b[i]) return i;
+    }
+    return len;
+}
+
+#if defined(__x86_64__)
+// Compare 32 bytes per instruction and 128 bytes per iteration. Only called if the CPU supports AVX2
+__attribute__((target("avx2")))
+static size_t first_difference_avx2(const unsigned char *a, const unsigned char *b, size_t len) {
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128) {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)), _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        __m256i eq2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 64)), _mm256_loadu_si256((const __m256i *)(b + i + 64)));
+        __m256i eq3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 96)), _mm256_loadu_si256((const __m256i *)(b + i + 96)));
+        __m256i eq = _mm256_and_si256(_mm256_and_si256(eq0, eq1), _mm256_and_si256(eq2, eq3));
+        // Some byte differs. The loop below finds which one
+        if ((unsigned int)_mm256_movemask_epi8(eq) != 0xffffffffu) break;
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(eq);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + first_difference_scalar(a + i, b + i, len - i);
+}
+
+// Compare 16 bytes per instruction and 64 bytes per iteration. Every x86-64 CPU supports SSE2
+static size_t first_difference_sse2(const unsigned char *a, const unsigned char *b, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)), _mm_loadu_si128((const __m128i *)(b + i + 16)));
+        __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)), _mm_loadu_si128((const __m128i *)(b + i + 32)));
+        __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)), _mm_loadu_si128((const __m128i *)(b + i + 48)));
+        __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+        if (_mm_movemask_epi8(eq) != 0xffff) break;
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned int mask = ~_mm_movemask_epi8(eq) & 0xffff;
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + first_difference_scalar(a + i, b + i, len - i);
+}
+#endif
+
+size_t first_difference(const void *a, const void *b, size_t len) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) return first_difference_avx2(a, b, len);
+    return first_difference_sse2(a, b, len);
+#else
+    return first_difference_scalar(a, b, len);
+#endif
+}
+
+// Read up to 'count' bytes. Less bytes are only read if the file ends first
+static size_t read_block(int fd, char *buffer, size_t count) {
+    size_t total = 0;
+    while (total < count) {
+        ssize_t n = read(fd, buffer + total, count - total);
+        if (n == -1) {
+            perror("read()");
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    stats_count(COUNT_READ, total);
+    return total;
+}
+
+// Compare 2 files by reading them in buffers of 'bufLen' bytes
+static off_t compare_buffered(int fdA, int fdB, off_t size, char *bufA, char *bufB, size_t bufLen) {
+    for (off_t offset = 0; offset < size; offset += bufLen) {
+        size_t n = (size - offset < (off_t)bufLen) ? (size_t)(size - offset) : bufLen;
+        size_t nA = read_block(fdA, bufA, n);
+        size_t nB = read_block(fdB, bufB, n);
+        size_t difference = first_difference(bufA, bufB, (nA < nB) ? nA : nB);
+        // A file that got shorter since it was scanned differs where it ends
+        if (difference < n) return offset + difference;
+    }
+    return -1;
+}
+
+// Compare 2 files by mapping them to memory, one window at a time. Sets '*result' as compare_files() returns it.
+// Returns false if the files can't be mapped, as some filesystems don't support it
+static int compare_mapped(int fdA, int fdB, off_t size, off_t *result) {
+    char *mapA = mmap(NULL, size, PROT_READ, MAP_SHARED, fdA, 0);
+    if (mapA == MAP_FAILED) return 0;
+    char *mapB = mmap(NULL, size, PROT_READ, MAP_SHARED, fdB, 0);
+    if (mapB == MAP_FAILED) {
+        munmap(mapA, size);
+        return 0;
+    }
+    madvise(mapA, size, MADV_SEQUENTIAL);
+    madvise(mapB, size, MADV_SEQUENTIAL);
+
+    *result = -1;
+    for (off_t offset = 0; offset < size; offset += MMAP_WINDOW) {
+        size_t n = (size - offset < MMAP_WINDOW) ? (size_t)(size - offset) : MMAP_WINDOW;
+        size_t difference = first_difference(mapA + offset, mapB + offset, n);
+        stats_count(COUNT_READ, 2 * ((difference < n) ? difference + 1 : n));
+        if (difference < n) {
+            *result = offset + difference;
+            break;
+        }
+        madvise(mapA + offset, n, MADV_DONTNEED);
+        madvise(mapB + offset, n, MADV_DONTNEED);
+    }
+
+    if (munmap(mapA, size) == -1 || munmap(mapB, size) == -1) {
+        perror("munmap()");
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+off_t compare_files(int fdA, int fdB, off_t size) {
+    // A file whose size changed since it was scanned differs from the start. Reading a mapping past the
+    // end of a file that got shorter would raise SIGBUS
+    struct stat myStat, otherStat;
+    if (fstat(fdA, &myStat) == -1 || fstat(fdB, &otherStat) == -1) {
+        perror("fstat()");
+        exit(EXIT_FAILURE);
+    }
+    if (myStat.st_size != size || otherStat.st_size != size) return 0;
+
+    off_t result;
+    if (size >= MMAP_MIN && compare_mapped(fdA, fdB, size, &result)) return result;
+
+    posix_fadvise(fdA, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fdB, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Read whole blocks of the filesystem, and the whole file at once if it fits in the largest buffer
+    size_t blockSize = (myStat.st_blksize > 0) ? (size_t)myStat.st_blksize : 4096;
+    if (blockSize > BUFFER_MAX) blockSize = BUFFER_MAX;
+    size_t bufLen = ((size_t)size + blockSize - 1) / blockSize * blockSize;
+    if (bufLen > BUFFER_MAX) bufLen = BUFFER_MAX / blockSize * blockSize;
+
+    // Page aligned buffers let the kernel copy whole pages
+    _Alignas(4096) char bufA[BUFFER_MAX];
+    _Alignas(4096) char bufB[BUFFER_MAX];
+    return compare_buffered(fdA, fdB, size, bufA, bufB, bufLen);
+}
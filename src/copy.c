@@ -0,0 +1,122 @@
+#define _GNU_SOURCE                 // copy_file_range()
+
+#include <errno.h>          // errno
+#include <linux/fs.h>       // FICLONE
+#include <stdatomic.h>      // atomic_ulong etc.
+#include <stdio.h>          // perror() etc.
+#include <stdlib.h>         // exit() etc.
+#include <sys/ioctl.h>      // ioctl()
+#include <sys/sendfile.h>   // sendfile()
+#include <unistd.h>         // copy_file_range() etc.
+
+#include "copy.h"
+#include "stats.h"          // stats_count()
+#include "utils.h"          // fullwrite()
+
+// Most bytes that a single copy_file_range() or sendfile() is asked to copy
+#define COPY_CHUNK (64 * 1024 * 1024)
+// Size of the buffer of the last method
+#define COPY_BUFFER_LEN (128 * 1024)
+
+static const char *methodNames[COPY_METHODS] = {"clone", "range", "sendfile", "buffer", "uring"};
+
+// Files, and bytes of files, copied by every method
+static atomic_ulong methodFiles[COPY_METHODS];
+static atomic_ulong methodBytes[COPY_METHODS];
+
+// Set once the kernel turns out not to have copy_file_range(), so it is not tried again
+static atomic_int noCopyRange;
+
+// Returns true if a failed copy means that the method is not supported for these files, so the next method
+// should be tried. Any other failure is fatal
+static int unsupported(int error) {
+    return error == EOPNOTSUPP || error == ENOTTY || error == EXDEV || error == EINVAL || error == ENOSYS;
+}
+
+// Count a file copied by given method, and return the method
+static int copied(int method, off_t size) {
+    atomic_fetch_add_explicit(&methodFiles[method], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&methodBytes[method], size, memory_order_relaxed);
+    stats_count(COUNT_WRITTEN, size);
+    return method;
+}
+
+int copy_contents(int fromFd, int toFd, off_t size) {
+    // Empty files need no copying
+    if (size == 0) return copied(COPY_BUFFER, 0);
+
+    // A reflink is all or nothing
+    if (ioctl(toFd, FICLONE, fromFd) == 0) return copied(COPY_CLONE, size);
+    if (!unsupported(errno)) {
+        perror("ioctl()");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every method below continues from where the previous one stopped. copy_file_range() is given no
+    // offset for the new file, so it moves the file offset of the new file, as sendfile() and write() do
+    // NOTE: The copy ends early if the old file got shorter since it was scanned
+    off_t offset = 0;
+    int method = COPY_RANGE;
+    while (method == COPY_RANGE && offset < size) {
+        if (atomic_load_explicit(&noCopyRange, memory_order_relaxed)) {
+            method = COPY_SENDFILE;
+            break;
+        }
+        size_t chunk = (size - offset < COPY_CHUNK) ? (size_t)(size - offset) : COPY_CHUNK;
+        ssize_t n = copy_file_range(fromFd, &offset, toFd, NULL, chunk, 0);
+        if (n == 0) return copied(method, offset);
+        if (n == -1) {
+            if (!unsupported(errno)) {
+                perror("copy_file_range()");
+                exit(EXIT_FAILURE);
+            }
+            if (errno == ENOSYS) atomic_store(&noCopyRange, 1);
+            method = COPY_SENDFILE;
+        }
+    }
+    while (method == COPY_SENDFILE && offset < size) {
+        size_t chunk = (size - offset < COPY_CHUNK) ? (size_t)(size - offset) : COPY_CHUNK;
+        ssize_t n = sendfile(toFd, fromFd, &offset, chunk);
+        if (n == 0) return copied(method, offset);
+        if (n == -1) {
+            if (!unsupported(errno)) {
+                perror("sendfile()");
+                exit(EXIT_FAILURE);
+            }
+            method = COPY_BUFFER;
+        }
+    }
+    if (method == COPY_BUFFER && offset < size) {
+        char buffer[COPY_BUFFER_LEN];
+        ssize_t n;
+        while ((n = pread(fromFd, buffer, sizeof(buffer), offset)) > 0) {
+            fullwrite(toFd, buffer, n);
+            offset += n;
+        }
+        if (n == -1) {
+            perror("pread()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return copied(method, offset);
+}
+
+void copy_count(int method, off_t size) {
+    copied(method, size);
+}
+
+void copy_report(FILE *stream, int json) {
+    if (json) {
+        for (int method = 0; method < COPY_METHODS; method++) {
+            fprintf(stream, "%s\"%s\":{\"files\":%lu,\"bytes\":%lu}", (method == 0) ? "{" : ",", methodNames[method],
+                    atomic_load(&methodFiles[method]), atomic_load(&methodBytes[method]));
+        }
+        fprintf(stream, "}");
+        return;
+    }
+    fprintf(stream, "Copy methods:\n");
+    for (int method = 0; method < COPY_METHODS; method++) {
+        fprintf(stream, "\t%-8s %12lu files %16lu bytes\n", methodNames[method],
+                atomic_load(&methodFiles[method]), atomic_load(&methodBytes[method]));
+    }
+}
@@ -1,38 +1,64 @@
 #include <errno.h>              // errno
 #include <fcntl.h>              // O_FLAGS
+#include <limits.h>             // PATH_MAX
+#include <pthread.h>            // pthread_mutex_t etc.
 #include <stdio.h>              // fprintf() etc.
 #include <stdlib.h>             // exit() etc.
 #include <string.h>             // strlen() etc.
 #include <sys/stat.h>           // mkdir() etc.
 #include <unistd.h>             // link() etc.
 
+#include "copy.h"               // copy_contents()
 #include "entry_manager.h"
 #include "info.h"               // GlobalInfo
+#include "stats.h"              // stats_count()
 #include "utils.h"              // NULL_CHECK() etc.
 
 extern GlobalInfo *info;
 
+// Guards the hardlinks table of 'info'
+static pthread_mutex_t hardlinksLock = PTHREAD_MUTEX_INITIALIZER;
+
 // Initialize an entry
-EntryInfo *entry_init(char *relativePath, char *name, char fromHierarchy) {
+EntryInfo *entry_init(int dirFd, char *parentPath, char *name, char fromHierarchy, Arena *arena) {
     // Stat init
+    // NOTE: The entry is looked up in its (already open) parent directory, so the kernel
+    // does not have to resolve the whole path again for every entry
     struct stat myStat;
-    if (lstat(relativePath, &myStat) == -1) {
-        perror("lstat()");
+    stats_count(COUNT_LSTAT, 1);
+    if (fstatat(dirFd, name, &myStat, AT_SYMLINK_NOFOLLOW) == -1) {
+        perror("fstatat()");
         exit(EXIT_FAILURE);
     }
+    return entry_from_stat(&myStat, parentPath, name, fromHierarchy, arena);
+}
+
+// Initialize an entry whose stat is already known
+EntryInfo *entry_from_stat(struct stat *myStat, char *parentPath, char *name, char fromHierarchy, Arena *arena) {
+    // The entry and its relative path are a single allocation in the arena
+    // NOTE: The path is built from the path of the parent directory, which is already relative
+    // to the executable. relativeToHier and name point inside of it
+    size_t parentLen = strlen(parentPath);
+    int slash = (parentPath[parentLen-1] != '/');
+    size_t nameOffset = parentLen + slash;
+    EntryInfo *entry = arena_alloc(arena, sizeof(*entry) + nameOffset + strlen(name) + 1);
+    char *relativePath = (char *)(entry + 1);
+    memcpy(relativePath, parentPath, parentLen);
+    if (slash) relativePath[parentLen] = '/';
+    strcpy(relativePath + nameOffset, name);
 
     // File type init
     char fileType;
-    switch (myStat.st_mode & __S_IFMT) {
+    switch (myStat->st_mode & __S_IFMT) {
         case __S_IFREG:
-            if (myStat.st_nlink > 1) fileType = HARDLINK;
+            if (myStat->st_nlink > 1) fileType = HARDLINK;
             else fileType = REGFILE;
             break;
         case __S_IFDIR:
             fileType = DIRECTORY;
             break;
         case __S_IFLNK:
-            // Ignore symlinks pointing outside the hierarchy
+            // Ignore symlinks pointing outside the hierarchy. Their few bytes stay unused in the arena
             if (!symlink_in_hierachy(relativePath, fromHierarchy)) return NULL;
             fileType = SYMLINK;
             break;
@@ -41,207 +67,110 @@ EntryInfo *entry_init(char *relativePath, char *name, char fromHierarchy) {
             exit(EXIT_FAILURE);
     }
 
-    // We allocate memory here in case the previous switch returns NULL
-    EntryInfo *entry = malloc(sizeof(*entry));
-    NULL_CHECK(entry, "malloc");
+    stats_count((fromHierarchy == HIER_A) ? COUNT_ENTRIES_A : COUNT_ENTRIES_B, 1);
+
     // File Type
     entry->fileType = fileType;
-    // Inode
-    entry->inode = myStat.st_ino;
+    // Device and inode
+    entry->device = myStat->st_dev;
+    entry->inode = myStat->st_ino;
+    entry->links = myStat->st_nlink;
     // Size
-    entry->size = myStat.st_size;
+    entry->size = myStat->st_size;
     // Mtime
-    entry->mtime = myStat.st_mtime;
+    entry->mtime = myStat->st_mtim.tv_sec;
+    entry->mtimeNsec = myStat->st_mtim.tv_nsec;
     // Permissions
-    entry->perms = myStat.st_mode;
+    entry->perms = myStat->st_mode;
 
-    // Relative path
-    // Case: relativePath is a relative path
-    if (relativePath[0] != '/') entry->relativePath = duplicate_string(relativePath);
-    // Case: relativePath is an absolute path. Convert it to relative before continuing
-    else {
-        // Case: Executable's hierarchy is a substring of relativePath's absolute path
-        if (strstr(relativePath, info->exeDir) != NULL) {
-            entry->relativePath = malloc((strlen(relativePath) - info->lenExe + 3) * sizeof(char));
-            NULL_CHECK(entry->relativePath, "malloc");
-            entry->relativePath[0] = '.';
-            entry->relativePath[1] = '\0';
-            strcat(entry->relativePath, relativePath+info->lenExe-1);
-        }
-        // Case: Executable's hierarchy is deeper than relativePath's absolute path
-        else {
-            // Get the offset of the folders that are common in both hierarchies
-            int i = 0, offset = 0, parentsCount = 0;
-            while (info->exeDir[i] == relativePath[i]) {
-                if (info->exeDir[i] == '/') offset = i+1;
-                i++;
-            }
-
-            // Count how many folders of executable's path need to be replaced by '..'
-            char *duplicate = duplicate_string(info->exeDir+offset);
-            char *token = strtok(duplicate, "/");
-            while (token != NULL) {
-                parentsCount++;
-                token = strtok(NULL, "/");
-            }
-
-            // Since executable is deeper than relativePath, build entry->relativePath using '..'
-            size_t len = strlen(relativePath+offset) + 3*parentsCount;
-            entry->relativePath = malloc((len + 1) * sizeof(char));
-            i = 0;
-            while (parentsCount) {
-                strcpy(entry->relativePath+i, "../");
-                i += 3;
-                parentsCount--;
-            }
-            strcat(entry->relativePath, relativePath+offset);
-            entry->relativePath[len] = '\0';
-
-            free(duplicate);
-        }
-    }
-    
-    // Name
-    entry->name = duplicate_string(name); 
+    // Paths
+    entry->relativePath = relativePath;
+    entry->name = relativePath + nameOffset;
 
     // From
     entry->fromHierarchy = fromHierarchy;
 
-    // Absolute path
-    if (entry->fileType != SYMLINK) {
-        entry->absolutePath = realpath(entry->relativePath, NULL);
-        NULL_CHECK(entry->absolutePath, "realpath");
-    }
-    else entry->absolutePath = get_absolute_path(info->exeDir, entry->relativePath);
-
     // Relative path in relation to hierarchy
-    size_t hierLen = (fromHierarchy == HIER_A) ? info->lenA : info->lenB;
-    entry->relativeToHier = malloc((strlen(entry->absolutePath) - hierLen + 1) * sizeof(char));
-    NULL_CHECK(entry->relativeToHier, "malloc");
-    strcpy(entry->relativeToHier, entry->absolutePath + hierLen);
+    size_t rootLen = (fromHierarchy == HIER_A) ? info->lenRelA : info->lenRelB;
+    entry->relativeToHier = relativePath + rootLen;
 
     return entry;
 }
 
-// Destroy an entry using appropriate memory deallocation
-void entry_destroy(EntryInfo *entry) {
-    free(entry->relativePath);
-    free(entry->absolutePath);
-    free(entry->name);
-    free(entry->relativeToHier);
-    free(entry);
-}
-
 // Returns true if given symlink points inside given hierarchy. False otherwise
 int symlink_in_hierachy(char *symlink, char hierarchy) {
-    char *filePath = realpath(symlink, NULL);
-    if (filePath == NULL) return 0;
+    char filePath[PATH_MAX];
+    stats_count(COUNT_REALPATH, 1);
+    if (realpath(symlink, filePath) == NULL) return 0;
 
-    int inHier;
-    if (hierarchy == HIER_A) inHier = !strncmp(info->hierarchyA, filePath, info->lenA);
-    else inHier = !strncmp(info->hierarchyB, filePath, info->lenB);
-
-    free(filePath);
-
-    return inHier;
+    if (hierarchy == HIER_A) return !strncmp(info->hierarchyA, filePath, info->lenA);
+    else return !strncmp(info->hierarchyB, filePath, info->lenB);
 }
 
-// Returns true if 2 files are the same. False otherwise
-int files_are_same(EntryInfo *entryA, EntryInfo *entryB) {
-    // If they have different sizes, they are definitely different
-    if (entryA->size != entryB->size) return 0;
-    // If they are both empty, they are definitely the same
-    else if (entryA->size == 0) return 1;
-    
-    // Compare files' content
-    int fdA = open(entryA->relativePath, O_RDONLY);
-    if (fdA == -1) {
-        perror("open()");
-        exit(EXIT_FAILURE);
-    }
-    int fdB = open(entryB->relativePath, O_RDONLY);
-    if (fdB == -1) {
+// Open the file of an entry for reading. Returns -1 if the entry, or one of its parents, no longer exists
+int entry_try_open(EntryInfo *entry) {
+    stats_count(COUNT_OPEN, 1);
+    int fd = open(entry->relativePath, O_RDONLY);
+    if (fd == -1 && errno != ENOENT && errno != ENOTDIR) {
         perror("open()");
         exit(EXIT_FAILURE);
     }
+    return fd;
+}
 
-    // Create 2 buffers that will be used to store the contents of files
-    char bufA[BUFLEN];
-    char bufB[BUFLEN];
-
-    int areSame = 0;
-    ssize_t n;
-    while ((n = read(fdA, bufA, sizeof(bufA))) > 0) {
-        fullread(fdB, bufB, n); // Assure that exactly "n" bytes are read from fileB too
-        areSame = !memcmp(bufA, bufB, n);
-        if (!areSame) break;
-    }
-
-    // Close everything
-    if (close(fdA) == -1 || close(fdB) == -1) {
-        perror("close()");
+// Open the file of an entry for reading
+int entry_open(EntryInfo *entry) {
+    int fd = entry_try_open(entry);
+    if (fd == -1) {
+        perror("open()");
         exit(EXIT_FAILURE);
     }
-
-    return areSame;
+    return fd;
 }
 
-// Returns true if given symlink are the same. False otherwise
+// Returns true if given symlink are the same. False otherwise, or -1 if either of them no longer resolves
 int symlinks_are_same(EntryInfo *entryA, EntryInfo *entryB) {
     // Check if they are the same by comparing their realpaths
+    stats_count(COUNT_REALPATH, 2);
     char *bufA = realpath(entryA->relativePath, NULL);
-    NULL_CHECK(bufA, "realpath");
-    char *bufB = realpath(entryB->relativePath, NULL);
-    NULL_CHECK(bufB, "realpath");
+    char *bufB = (bufA != NULL) ? realpath(entryB->relativePath, NULL) : NULL;
+    if (bufB == NULL) {
+        // A symlink that was removed, or whose target was, no longer resolves
+        if (errno != ENOENT && errno != ENOTDIR) {
+            perror("realpath()");
+            exit(EXIT_FAILURE);
+        }
+        free(bufA);
+        return -1;
+    }
     int areSame = !strcmp(bufA, bufB);
     free(bufA);
     free(bufB);
     return areSame;
 }
 
-// Return true if 2 entries are the same. False otherwise
-int entries_are_same(EntryInfo *entryA, EntryInfo *entryB) {
-    // Compare the entries according to their file type
-    switch (entryA->fileType) {
-        case REGFILE:
-        case HARDLINK:
-            return files_are_same(entryA, entryB);
-        case DIRECTORY:
-            return !strcmp(entryA->relativeToHier, entryB->relativeToHier);
-        case SYMLINK:
-            return symlinks_are_same(entryA, entryB);
-        default:
-            fprintf(stderr, "Unkown file type\n");
-            exit(EXIT_FAILURE);
-    }
-}
-
-// Copy from file 'from' to file 'to'
-void copy_file(EntryInfo *fromEntry, char *to) {
-    char *from = fromEntry->relativePath;
-    int n, fromFd, toFd;
-    char buffer[BUFLEN];
-
-    // Create the new file
-    if ((toFd = open(to, O_CREAT | O_EXCL | O_WRONLY, fromEntry->perms)) == -1) {
+// Create the new file of a copy. Returns its file descriptor, or -1 if the file must not be copied
+static int create_file(EntryInfo *fromEntry, char *to) {
+    stats_count(COUNT_OPEN, 1);
+    int toFd = open(to, O_CREAT | O_EXCL | O_WRONLY, fromEntry->perms);
+    if (toFd == -1) {
         // If another entry with the same name was already created, don't re-create
-        if (errno == EEXIST) return;
+        if (errno == EEXIST) return -1;
         // If the parent directory was not copied, ignore this file
-        if (errno == ENOTDIR) return;
+        if (errno == ENOTDIR) return -1;
         perror("open()");
         exit(EXIT_FAILURE);
     }
-    
+    return toFd;
+}
+
+// Copy the contents of an entry to its new file 'toFd', and close it
+static void fill_file(EntryInfo *fromEntry, int toFd) {
     // Open the old file
-    if ((fromFd = open(from, O_RDONLY)) == -1) {
-        perror("open()");
-        exit(EXIT_FAILURE);
-    }
+    int fromFd = entry_open(fromEntry);
 
-    // Do the writing
-    while ((n = read(fromFd, buffer, sizeof(buffer))) > 0) {
-        fullwrite(toFd, buffer, n);
-    }
+    // Do the copying, without passing the data through user space whenever possible
+    copy_contents(fromFd, toFd, fromEntry->size);
 
     // Close everything
     if (close(fromFd) == -1 || close(toFd) == -1) {
@@ -250,6 +179,12 @@ void copy_file(EntryInfo *fromEntry, char *to) {
     }
 }
 
+// Copy from file 'from' to file 'to'
+void copy_file(EntryInfo *fromEntry, char *to) {
+    int toFd = create_file(fromEntry, to);
+    if (toFd != -1) fill_file(fromEntry, toFd);
+}
+
 // Copy a symlink to the new hierarchy
 void copy_symlink(EntryInfo *entry, char *newSymlink) {
     char linksTo[BUFLEN];
@@ -266,26 +201,42 @@ void copy_symlink(EntryInfo *entry, char *newSymlink) {
             exit(EXIT_FAILURE);
         }
     }
+    else stats_count(COUNT_LINKED, 1);
 }
 
 // Manage the copying of the hardlinks
 void manage_hardlinks(EntryInfo *entry, char *destination) {
-    // Try to locate the file with the same i-node in the AVL tree
-    char *path = avl_find(info->avl_hardlinks, entry->inode);
+    // Try to locate the file with the same device and i-node in the link table. If not found, create
+    // the file in the new dirC, and store its path for future references to it (for hardlink-creation)
+    // NOTE: The merge may run on multiple threads. The file is created while the table is locked, so
+    // every i-node is copied once, and its other names always find a file to link to. The contents
+    // are copied after the table is unlocked, as a link to the new file doesn't depend on them
+    pthread_mutex_lock(&hardlinksLock);
+    char *path = link_table_find(info->hardlinks, entry->device, entry->inode);
+    int toFd = -1;
+    if (path == NULL) {
+        toFd = create_file(entry, destination);
+        link_table_insert(info->hardlinks, entry->device, entry->inode, entry->links, destination);
+    }
+    pthread_mutex_unlock(&hardlinksLock);
+
     // If found, simply create a hardlink to the same disk-file
     if (path != NULL) {
-        if (link(path, destination) == -1) {
-            if (errno == EEXIST) return;
-            perror("link()");
-            exit(EXIT_FAILURE);
-        }
+        link_file(path, destination);
+        free(path);
     }
-    // Otherwise, copy the file to the new dirC, and store its path
-    // for future references to it (for hardlink-creation)
-    else {
-        copy_file(entry, destination);
-        avl_insert(info->avl_hardlinks, entry->inode, destination);
+    else if (toFd != -1) fill_file(entry, toFd);
+}
+
+// Link 'destination' to the existing file 'target'
+void link_file(char *target, char *destination) {
+    if (link(target, destination) == -1) {
+        // If another entry with the same name was already created, don't re-create
+        if (errno == EEXIST) return;
+        perror("link()");
+        exit(EXIT_FAILURE);
     }
+    stats_count(COUNT_LINKED, 1);
 }
 
 // Create an entry to the new hierarchy
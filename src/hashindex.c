@@ -0,0 +1,78 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc() etc.
+#include <string.h>     // strcmp()
+
+#include "hashindex.h"
+#include "utils.h"      // NULL_CHECK() etc.
+
+// Open addressing with linear probing. Every slot keeps the full hash of its key, so
+// a probe only falls back to strcmp() when the hashes are equal
+typedef struct {
+    unsigned long hash;
+    int position;       // Position of the key in the indexed arrays. -1 marks an empty slot
+} Slot;
+
+struct hash_index {
+    char *strings;
+    size_t *keys;
+    Slot *slots;
+    size_t mask;        // Number of slots minus one. The number of slots is a power of 2
+    int ownsSlots;      // Whether the slots were allocated by the index, or loaded from a saved table
+};
+
+HashIndex *hash_index_create(unsigned long *hashes, char *strings, size_t *keys, int start, int end) {
+    HashIndex *index = malloc(sizeof(*index));
+    NULL_CHECK(index, "malloc");
+    index->strings = strings;
+    index->keys = keys;
+
+    // Keep the load factor at or below 1/2 so that probe sequences stay short
+    size_t capacity = 4;
+    while (capacity < 2 * (size_t)(end - start)) capacity *= 2;
+    index->mask = capacity - 1;
+    // Cleared, so that a saved table has no undefined bytes
+    index->slots = calloc(capacity, sizeof(*index->slots));
+    NULL_CHECK(index->slots, "calloc");
+    index->ownsSlots = 1;
+    for (size_t i = 0; i < capacity; i++) index->slots[i].position = -1;
+
+    for (int i = start; i < end; i++) {
+        unsigned long hash = hashes[i];
+        size_t s = hash & index->mask;
+        while (index->slots[s].position != -1) s = (s + 1) & index->mask;
+        index->slots[s].hash = hash;
+        index->slots[s].position = i;
+    }
+    return index;
+}
+
+int hash_index_find(HashIndex *index, unsigned long hash, char *key) {
+    for (size_t s = hash & index->mask; index->slots[s].position != -1; s = (s + 1) & index->mask) {
+        if (index->slots[s].hash != hash) continue;
+        if (!strcmp(index->strings + index->keys[index->slots[s].position], key)) {
+            return index->slots[s].position;
+        }
+    }
+    return -1;
+}
+
+void *hash_index_table(HashIndex *index, size_t *size) {
+    *size = (index->mask + 1) * sizeof(*index->slots);
+    return index->slots;
+}
+
+HashIndex *hash_index_load(char *strings, size_t *keys, void *table, size_t size) {
+    HashIndex *index = malloc(sizeof(*index));
+    NULL_CHECK(index, "malloc");
+    index->strings = strings;
+    index->keys = keys;
+    index->slots = table;
+    index->mask = size / sizeof(*index->slots) - 1;
+    index->ownsSlots = 0;
+    return index;
+}
+
+void hash_index_destroy(HashIndex *index) {
+    if (index->ownsSlots) free(index->slots);
+    free(index);
+}
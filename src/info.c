@@ -8,19 +8,20 @@
 extern GlobalInfo *info;
 
 // Initialize the global variable 'info'
-void info_init(int argc, char *pathA, char *pathB, char *pathC) {
+void info_init(Options *options) {
     info = malloc(sizeof(*info));
     NULL_CHECK(info, "malloc");
+    info->options = *options;
 
     // Get realpath and length of pathA
-    char *temp = realpath(pathA, NULL);
+    char *temp = realpath(options->pathA, NULL);
     NULL_CHECK(temp, "realpath");
     info->hierarchyA = fix_path(temp);
     free(temp);
     info->lenA = strlen(info->hierarchyA);
 
     // Get realpath and length of pathB
-    temp = realpath(pathB, NULL);
+    temp = realpath(options->pathB, NULL);
     NULL_CHECK(temp, "realpath");
     info->hierarchyB = fix_path(temp);
     free(temp);
@@ -33,30 +34,44 @@ void info_init(int argc, char *pathA, char *pathB, char *pathC) {
     free(temp);
     info->lenExe = strlen(info->exeDir);
 
-    // If user wants to also merge, get realpath and length of pathC
-    if (argc == 6) {
-        temp = realpath(pathC, NULL);
+    // Get the paths of both hierarchies in relation to the executable. Relative paths of
+    // the entries are built on top of them
+    info->relativeA = (options->pathA[0] != '/') ? duplicate_string(options->pathA) : relative_path(info->exeDir, options->pathA);
+    info->lenRelA = strlen(info->relativeA);
+    info->relativeB = (options->pathB[0] != '/') ? duplicate_string(options->pathB) : relative_path(info->exeDir, options->pathB);
+    info->lenRelB = strlen(info->relativeB);
+
+    // If user gave a signature cache, open it
+    info->cache = (options->cachePath != NULL) ? cache_open(options->cachePath) : NULL;
+
+    // If user wants to also merge, get realpath and length of pathC. A dry run
+    // never creates pathC, so it may not exist
+    if (options->pathC != NULL && !options->dryRun) {
+        temp = realpath(options->pathC, NULL);
         NULL_CHECK(temp, "realpath");
         info->hierarchyC = fix_path(temp);
         free(temp);
         info->lenC = strlen(info->hierarchyC);
-        info->avl_hardlinks = avl_create();
+        info->hardlinks = link_table_create();
     }
     else {
         info->hierarchyC = NULL;
         info->lenC = 0;
-        info->avl_hardlinks = NULL;
+        info->hardlinks = NULL;
     }
 }
 
 // Destroy the global variable 'info'
-void info_destroy(int argc) {
+void info_destroy(void) {
+    if (info->cache != NULL) cache_close(info->cache);
     free(info->hierarchyA);
     free(info->hierarchyB);
     free(info->exeDir);
-    if (argc == 6) {
+    free(info->relativeA);
+    free(info->relativeB);
+    if (info->hierarchyC != NULL) {
         free(info->hierarchyC);
-        avl_destroy(info->avl_hardlinks);
+        link_table_destroy(info->hardlinks);
     }
     free(info);
 }
\ No newline at end of file
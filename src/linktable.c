@@ -0,0 +1,114 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc() etc.
+
+#include "linktable.h"
+#include "utils.h"      // NULL_CHECK() etc.
+
+// Open addressing with linear probing. Removed files shift the following slots of their probe
+// sequence back, so no tombstones are left behind and probe sequences stay short
+typedef struct {
+    dev_t device;
+    ino_t inode;
+    nlink_t remaining;  // Names of the file not yet seen
+    char *path;         // Path of the copy. NULL marks an empty slot
+} Slot;
+
+struct link_table {
+    Slot *slots;
+    size_t mask;        // Number of slots minus one. The number of slots is a power of 2
+    size_t count;       // Number of used slots
+};
+
+// Mix the bits of a device and an inode, as consecutive inodes are common
+static size_t link_hash(dev_t device, ino_t inode) {
+    unsigned long long key = (unsigned long long)inode ^ ((unsigned long long)device << 32) ^ ((unsigned long long)device >> 32);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static Slot *slots_alloc(size_t capacity) {
+    Slot *slots = malloc(capacity * sizeof(*slots));
+    NULL_CHECK(slots, "malloc");
+    for (size_t i = 0; i < capacity; i++) slots[i].path = NULL;
+    return slots;
+}
+
+LinkTable *link_table_create(void) {
+    LinkTable *table = malloc(sizeof(*table));
+    NULL_CHECK(table, "malloc");
+    table->mask = 63;
+    table->count = 0;
+    table->slots = slots_alloc(table->mask + 1);
+    return table;
+}
+
+// Returns the slot of given file, or the empty slot that ends its probe sequence
+static Slot *slot_find(LinkTable *table, dev_t device, ino_t inode) {
+    size_t s = link_hash(device, inode) & table->mask;
+    while (table->slots[s].path != NULL && (table->slots[s].device != device || table->slots[s].inode != inode)) {
+        s = (s + 1) & table->mask;
+    }
+    return &table->slots[s];
+}
+
+// Double the number of slots
+static void table_grow(LinkTable *table) {
+    Slot *old = table->slots;
+    size_t oldCapacity = table->mask + 1;
+    table->mask = 2 * oldCapacity - 1;
+    table->slots = slots_alloc(2 * oldCapacity);
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].path != NULL) *slot_find(table, old[i].device, old[i].inode) = old[i];
+    }
+    free(old);
+}
+
+void link_table_insert(LinkTable *table, dev_t device, ino_t inode, nlink_t links, char *path) {
+    if (links <= 1) return;
+    // Keep the load factor at or below 1/2 so that probe sequences stay short
+    if (2 * (table->count + 1) > table->mask + 1) table_grow(table);
+
+    Slot *slot = slot_find(table, device, inode);
+    if (slot->path != NULL) {
+        fprintf(stderr, "No duplicates in link table\n");
+        exit(EXIT_FAILURE);
+    }
+    slot->device = device;
+    slot->inode = inode;
+    slot->remaining = links - 1;
+    slot->path = duplicate_string(path);
+    table->count++;
+}
+
+// Empty given slot, and move back the following slots whose probe sequence passes through it
+static void slot_remove(LinkTable *table, size_t hole) {
+    free(table->slots[hole].path);
+    table->slots[hole].path = NULL;
+    table->count--;
+    for (size_t s = (hole + 1) & table->mask; table->slots[s].path != NULL; s = (s + 1) & table->mask) {
+        size_t home = link_hash(table->slots[s].device, table->slots[s].inode) & table->mask;
+        // The slot stays if its home lies cyclically in (hole, s]
+        if (((s - home) & table->mask) < ((s - hole) & table->mask)) continue;
+        table->slots[hole] = table->slots[s];
+        table->slots[s].path = NULL;
+        hole = s;
+    }
+}
+
+char *link_table_find(LinkTable *table, dev_t device, ino_t inode) {
+    Slot *slot = slot_find(table, device, inode);
+    if (slot->path == NULL) return NULL;
+    char *path = duplicate_string(slot->path);
+    // Once every name of the file was seen, no other name refers to it
+    // NOTE: More names are seen than counted if links were added after the scan. Those are copied anew
+    if (--slot->remaining == 0) slot_remove(table, slot - table->slots);
+    return path;
+}
+
+void link_table_destroy(LinkTable *table) {
+    for (size_t i = 0; i <= table->mask; i++) free(table->slots[i].path);
+    free(table->slots);
+    free(table);
+}
@@ -0,0 +1,300 @@
+#include <fcntl.h>          // open() etc.
+#include <stdint.h>         // uint64_t etc.
+#include <stdio.h>          // perror() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // memcmp() etc.
+#include <sys/mman.h>       // mmap() etc.
+#include <sys/stat.h>       // fstat()
+#include <unistd.h>         // close() etc.
+
+#include "info.h"           // GlobalInfo
+#include "manifest.h"
+#include "utils.h"          // NULL_CHECK() etc.
+
+// Identifies a manifest file
+#define MANIFEST_MAGIC "cmpcatmf"
+// Version of the layout of a manifest file. Raised whenever the layout, or the layout of a hash index, changes
+#define MANIFEST_VERSION 3
+// Every section starts at a multiple of this many bytes, so that any column can be used in place
+#define SECTION_ALIGN 64
+
+// Flags of a manifest file
+#define FLAG_DIRECTORY_STATS 1      // The directories were stat'ed, so their metadata is known (see scanner.h)
+
+// Sections of a manifest file
+#define SECTION_TYPES        0
+#define SECTION_SIZES        1
+#define SECTION_MTIMES       2
+#define SECTION_MTIME_NSECS  3
+#define SECTION_DEVICES      4
+#define SECTION_INODES       5
+#define SECTION_LINKS        6
+#define SECTION_PERMS        7
+#define SECTION_HASHES       8
+#define SECTION_PATHS        9
+#define SECTION_NAMES        10
+#define SECTION_PARENTS      11
+#define SECTION_COLUMNS      12     // Sections above hold a column each, with an element per entry
+#define SECTION_LEVELS       12     // Start of every level, and the end of the last one
+#define SECTION_STRINGS      13     // String pool
+#define SECTION_TABLES       14     // Tables of the hash indexes of all levels, one after the other
+#define SECTION_TABLE_SIZES  15     // Size in bytes of the table of every level
+#define SECTION_DIGESTS      16     // Signature of every entry. Empty if none is known
+#define SECTION_KNOWN        17     // Whether the signature of every entry is known. Empty along with the signatures
+#define SECTION_COUNT        18
+
+extern GlobalInfo *info;
+
+typedef struct {
+    uint64_t offset;        // Offset of the section in the file
+    uint64_t length;        // Length of the section in bytes
+    uint64_t elemSize;      // Size of an element of the section
+} Section;
+
+// Start of a manifest file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t lastLevel;
+    uint64_t count;         // Number of entries
+    int64_t rootLen;        // Length of the path of the hierarchy that precedes every relativeToHier
+    uint32_t flags;         // Uses #defines listed above
+    uint32_t reserved;
+    Section sections[SECTION_COUNT];
+} Header;
+
+// Returns the address of the column that given section holds, and stores the size of its elements in 'elemSize'
+static void **column_of(ArrayWrapper *wrapper, int section, uint64_t *elemSize) {
+    switch (section) {
+        case SECTION_TYPES:       *elemSize = sizeof(*wrapper->types);      return (void **)&wrapper->types;
+        case SECTION_SIZES:       *elemSize = sizeof(*wrapper->sizes);      return (void **)&wrapper->sizes;
+        case SECTION_MTIMES:      *elemSize = sizeof(*wrapper->mtimes);     return (void **)&wrapper->mtimes;
+        case SECTION_MTIME_NSECS: *elemSize = sizeof(*wrapper->mtimeNsecs); return (void **)&wrapper->mtimeNsecs;
+        case SECTION_DEVICES:     *elemSize = sizeof(*wrapper->devices);    return (void **)&wrapper->devices;
+        case SECTION_INODES:      *elemSize = sizeof(*wrapper->inodes);     return (void **)&wrapper->inodes;
+        case SECTION_LINKS:       *elemSize = sizeof(*wrapper->links);      return (void **)&wrapper->links;
+        case SECTION_PERMS:       *elemSize = sizeof(*wrapper->perms);      return (void **)&wrapper->perms;
+        case SECTION_HASHES:      *elemSize = sizeof(*wrapper->hashes);     return (void **)&wrapper->hashes;
+        case SECTION_PATHS:       *elemSize = sizeof(*wrapper->paths);      return (void **)&wrapper->paths;
+        case SECTION_NAMES:       *elemSize = sizeof(*wrapper->names);      return (void **)&wrapper->names;
+        default:                  *elemSize = sizeof(*wrapper->parents);    return (void **)&wrapper->parents;
+    }
+}
+
+// Write a section of 'length' bytes to the end of the file, after padding it to the alignment of sections
+static void section_write(int fd, uint64_t *end, Section *section, void *data, uint64_t length, uint64_t elemSize) {
+    static char padding[SECTION_ALIGN];
+    uint64_t pad = (SECTION_ALIGN - *end % SECTION_ALIGN) % SECTION_ALIGN;
+    fullwrite(fd, padding, pad);
+    section->offset = *end + pad;
+    section->length = length;
+    section->elemSize = elemSize;
+    fullwrite(fd, data, length);
+    *end = section->offset + length;
+}
+
+void manifest_save(ArrayWrapper *wrapper, char *path) {
+    char *tempPath = malloc(strlen(path) + sizeof(".tmp"));
+    NULL_CHECK(tempPath, "malloc");
+    sprintf(tempPath, "%s.tmp", path);
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+
+    // The header is written last, once the sections are laid out
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+    header.version = MANIFEST_VERSION;
+    header.lastLevel = wrapper->lastLevel;
+    header.count = wrapper->size;
+    header.rootLen = wrapper->rootLen;
+    header.flags = wrapper->directoryStats ? FLAG_DIRECTORY_STATS : 0;
+    fullwrite(fd, &header, sizeof(header));
+    uint64_t end = sizeof(header);
+
+    for (int s = 0; s < SECTION_COLUMNS; s++) {
+        uint64_t elemSize;
+        void **column = column_of(wrapper, s, &elemSize);
+        section_write(fd, &end, &header.sections[s], *column, wrapper->size * elemSize, elemSize);
+    }
+    section_write(fd, &end, &header.sections[SECTION_LEVELS], wrapper->levels,
+                  (wrapper->lastLevel + 2) * sizeof(*wrapper->levels), sizeof(*wrapper->levels));
+    section_write(fd, &end, &header.sections[SECTION_STRINGS], wrapper->strings, wrapper->stringsLen, 1);
+
+    // The tables of the indexes are saved as they are, so that loading does not have to rebuild them
+    uint64_t *tableSizes = malloc((wrapper->lastLevel + 1) * sizeof(*tableSizes));
+    NULL_CHECK(tableSizes, "malloc");
+    uint64_t tablesLen = 0;
+    for (int level = 0; level <= wrapper->lastLevel; level++) {
+        size_t size;
+        void *table = hash_index_table(wrapper->indexes[level], &size);
+        if (level == 0) section_write(fd, &end, &header.sections[SECTION_TABLES], table, size, 1);
+        else {
+            fullwrite(fd, table, size);
+            end += size;
+        }
+        tableSizes[level] = size;
+        tablesLen += size;
+    }
+    header.sections[SECTION_TABLES].length = tablesLen;
+    section_write(fd, &end, &header.sections[SECTION_TABLE_SIZES], tableSizes,
+                  (wrapper->lastLevel + 1) * sizeof(*tableSizes), sizeof(*tableSizes));
+    free(tableSizes);
+
+    int hasDigests = (wrapper->digests != NULL);
+    section_write(fd, &end, &header.sections[SECTION_DIGESTS], wrapper->digests,
+                  hasDigests ? wrapper->size * sizeof(*wrapper->digests) : 0, SHA256_LEN);
+    section_write(fd, &end, &header.sections[SECTION_KNOWN], wrapper->digestsKnown,
+                  hasDigests ? wrapper->size * sizeof(*wrapper->digestsKnown) : 0, 1);
+
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        perror("pwrite()");
+        exit(EXIT_FAILURE);
+    }
+    if (fsync(fd) == -1) {
+        perror("fsync()");
+        exit(EXIT_FAILURE);
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    if (rename(tempPath, path) == -1) {
+        perror("rename()");
+        exit(EXIT_FAILURE);
+    }
+    free(tempPath);
+}
+
+// Exit on a manifest whose layout is not valid
+static void invalid(char *path) {
+    fprintf(stderr, "%s is not a valid manifest\n", path);
+    exit(EXIT_FAILURE);
+}
+
+// Returns the start of given section in the mapping of a manifest, after checking that it lies in the
+// mapping, that it is aligned, and that it holds 'length' bytes of elements of 'elemSize' bytes
+static void *section_data(char *path, char *map, size_t mapLen, Section *section, uint64_t length, uint64_t elemSize) {
+    if (section->offset % SECTION_ALIGN || section->offset > mapLen || section->length > mapLen - section->offset ||
+        section->elemSize != elemSize || section->length != length) invalid(path);
+    return map + section->offset;
+}
+
+// Rebuild the string pool and the paths of the entries, when the hierarchy is given through another
+// path than when its manifest was saved. The pool holds the relativePath of every entry, so every
+// relativeToHier is copied after the new path of the hierarchy
+static void paths_relocate(ArrayWrapper *wrapper, char *root, int rootLen) {
+    size_t *paths = malloc((wrapper->size + 1) * sizeof(*paths));
+    NULL_CHECK(paths, "malloc");
+    char *strings = malloc(wrapper->stringsLen - (size_t)wrapper->size * wrapper->rootLen + (size_t)wrapper->size * rootLen + 1);
+    NULL_CHECK(strings, "malloc");
+
+    size_t stringsLen = 0;
+    for (int i = 0; i < wrapper->size; i++) {
+        char *relativeToHier = wrapper->strings + wrapper->paths[i];
+        size_t len = strlen(relativeToHier) + 1;
+        memcpy(strings + stringsLen, root, rootLen);
+        memcpy(strings + stringsLen + rootLen, relativeToHier, len);
+        paths[i] = stringsLen + rootLen;
+        stringsLen += rootLen + len;
+    }
+    wrapper->paths = paths;
+    wrapper->strings = strings;
+    wrapper->stringsLen = stringsLen;
+    wrapper->rootLen = rootLen;
+}
+
+ArrayWrapper *manifest_load(char *path, char fromHierarchy) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    struct stat myStat;
+    if (fstat(fd, &myStat) == -1) {
+        perror("fstat()");
+        exit(EXIT_FAILURE);
+    }
+    size_t mapLen = myStat.st_size;
+    if (mapLen < sizeof(Header)) invalid(path);
+    char *map = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap()");
+        exit(EXIT_FAILURE);
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+
+    Header *header = (Header *)map;
+    if (memcmp(header->magic, MANIFEST_MAGIC, sizeof(header->magic)) || header->version != MANIFEST_VERSION ||
+        header->count > INT32_MAX - 1 || header->lastLevel < 0 || header->rootLen < 0) invalid(path);
+
+    ArrayWrapper *wrapper = malloc(sizeof(*wrapper));
+    NULL_CHECK(wrapper, "malloc");
+    wrapper->fromHierarchy = fromHierarchy;
+    wrapper->directoryStats = (header->flags & FLAG_DIRECTORY_STATS) != 0;
+    wrapper->map = map;
+    wrapper->mapLen = mapLen;
+    wrapper->index = wrapper->size = (int)header->count;
+    wrapper->lastLevel = header->lastLevel;
+    wrapper->rootLen = (int)header->rootLen;
+
+    // Every column is used in place
+    for (int s = 0; s < SECTION_COLUMNS; s++) {
+        uint64_t elemSize;
+        void **column = column_of(wrapper, s, &elemSize);
+        *column = section_data(path, map, mapLen, &header->sections[s], header->count * elemSize, elemSize);
+    }
+    wrapper->levels = section_data(path, map, mapLen, &header->sections[SECTION_LEVELS],
+                                   (header->lastLevel + 2) * sizeof(*wrapper->levels), sizeof(*wrapper->levels));
+    wrapper->stringsLen = header->sections[SECTION_STRINGS].length;
+    wrapper->strings = section_data(path, map, mapLen, &header->sections[SECTION_STRINGS], wrapper->stringsLen, 1);
+    // The levels split the entries, and the string pool ends with the end of a path
+    if (wrapper->levels[0] != 0 || wrapper->levels[wrapper->lastLevel + 1] != wrapper->size) invalid(path);
+    for (int level = 0; level <= wrapper->lastLevel; level++) {
+        if (wrapper->levels[level] > wrapper->levels[level+1]) invalid(path);
+    }
+    if (wrapper->size > 0 && (wrapper->stringsLen == 0 || wrapper->strings[wrapper->stringsLen - 1] != '\0')) invalid(path);
+
+    if (header->sections[SECTION_DIGESTS].length == 0) {
+        wrapper->digests = NULL;
+        wrapper->digestsKnown = NULL;
+    }
+    else {
+        wrapper->digests = section_data(path, map, mapLen, &header->sections[SECTION_DIGESTS],
+                                        header->count * SHA256_LEN, SHA256_LEN);
+        wrapper->digestsKnown = section_data(path, map, mapLen, &header->sections[SECTION_KNOWN], header->count, 1);
+    }
+
+    // The string pool starts with the path of the hierarchy as it was given when the manifest was saved
+    char *root = (fromHierarchy == HIER_A) ? info->relativeA : info->relativeB;
+    int rootLen = (fromHierarchy == HIER_A) ? info->lenRelA : info->lenRelB;
+    if (wrapper->size > 0 && (wrapper->rootLen != rootLen || memcmp(wrapper->strings, root, rootLen))) {
+        paths_relocate(wrapper, root, rootLen);
+    }
+    wrapper->rootLen = rootLen;
+
+    // The tables of the indexes are used in place too
+    uint64_t *tableSizes = section_data(path, map, mapLen, &header->sections[SECTION_TABLE_SIZES],
+                                        (header->lastLevel + 1) * sizeof(*tableSizes), sizeof(*tableSizes));
+    char *tables = section_data(path, map, mapLen, &header->sections[SECTION_TABLES],
+                                header->sections[SECTION_TABLES].length, 1);
+    wrapper->indexes = malloc((wrapper->lastLevel + 1) * sizeof(*wrapper->indexes));
+    NULL_CHECK(wrapper->indexes, "malloc");
+    uint64_t tablesLen = 0;
+    for (int level = 0; level <= wrapper->lastLevel; level++) {
+        // Every table has a power of 2 number of slots
+        uint64_t size = tableSizes[level];
+        if (size == 0 || (size & (size - 1)) || size > header->sections[SECTION_TABLES].length - tablesLen) invalid(path);
+        wrapper->indexes[level] = hash_index_load(wrapper->strings, wrapper->paths, tables + tablesLen, size);
+        tablesLen += size;
+    }
+    if (tablesLen != header->sections[SECTION_TABLES].length) invalid(path);
+
+    return wrapper;
+}
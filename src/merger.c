@@ -0,0 +1,391 @@
+#include <errno.h>          // errno etc.
+#include <fcntl.h>          // AT_FDCWD etc.
+#include <pthread.h>        // pthread_mutex_t etc.
+#include <stdio.h>          // perror() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <unistd.h>         // close()
+
+#include "copy.h"           // copy_contents() etc.
+#include "info.h"           // GlobalInfo
+#include "merger.h"
+#include "pool.h"           // ThreadPool
+#include "stats.h"          // stats_count()
+#include "uring.h"          // Uring
+#include "utils.h"          // NULL_CHECK() etc.
+
+extern GlobalInfo *info;
+
+// Number of submission entries of the io_uring instance
+#define MERGE_URING_ENTRIES 256
+// Most entries being created at once. A copy takes up to 6 requests, so every completion of
+// the entries in flight fits in the completion queue (twice the size of the submission queue)
+#define MERGE_REQUESTS 64
+// Largest file that is copied through io_uring. Every request owns a buffer of this size, which
+// the whole file is read into and written from. Larger files are copied inside the kernel
+#define URING_COPY_MAX (64 * 1024)
+
+// Most entries that a worker creates in one task
+#define MERGE_BATCH 64
+// Most batches that are queued or running at once, per worker
+#define MERGE_BATCHES_PER_WORKER 4
+
+// Steps of the creation of an entry. A copy is the chain open(to) -> open(from) -> read -> write ->
+// close(from) -> close(to), whose files are opened into slots of the ring's file table. An empty
+// file only needs open(to) -> close(to), and a directory a single mkdir
+#define STEP_OPEN_TO    0
+#define STEP_OPEN_FROM  1
+#define STEP_READ       2
+#define STEP_WRITE      3
+#define STEP_CLOSE_FROM 4
+#define STEP_CLOSE_TO   5
+#define STEP_MKDIR      6
+// Bits of the user data of a request that hold its step. The rest hold the index of its entry
+#define STEP_BITS 3
+
+// Entry being created through io_uring
+typedef struct {
+    EntryInfo entry;
+    char *destination;      // Absolute path of the entry in hierarchyC
+    char *buffer;           // Buffer the file is copied through
+    int pending;            // Requests of the entry not yet completed
+    int done;               // Bit per step that succeeded
+    int error;              // Error of the first step that failed, 0 if none. -1 if a read or write was short
+    int failedStep;         // Step that failed first
+} Request;
+
+// Entries created by a worker, in a single task
+typedef struct {
+    Merger *merger;
+    int count;                          // Number of entries
+    int directories;                    // Number of directories among them
+    EntryInfo entries[MERGE_BATCH];
+} Batch;
+
+struct merger {
+    // Synchronous backend, with multiple threads
+    // NOTE: Directories and files are batched apart, so that a barrier only waits for the directories
+    ThreadPool *pool;       // NULL if entries are created by the calling thread
+    Batch *directoryBatch;  // Batches being filled. NULL if empty
+    Batch *fileBatch;
+    pthread_mutex_t lock;   // Protects the counters below
+    pthread_cond_t released; // Signaled when a batch finishes
+    int batches;            // Batches submitted but not finished yet
+    int maxBatches;         // Limit of above batches
+    int pendingDirectories; // Directories of the above batches
+
+    // io_uring backend
+    Uring *ring;            // NULL if entries are created synchronously
+    Request requests[MERGE_REQUESTS];
+    int freeRequests[MERGE_REQUESTS];
+    int freeCount;
+    int directories;        // Directories being created
+    char *buffers;          // Buffers of all requests
+};
+
+// Opcodes of the requests that create the entries
+static const unsigned char opcodes[] = {IORING_OP_MKDIRAT, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+
+// Set up the io_uring backend. Returns false if io_uring can't be used
+static int merger_uring_init(Merger *merger) {
+    // Every request opens up to 2 files into slots of its own
+    if ((merger->ring = uring_create(MERGE_URING_ENTRIES)) == NULL || uring_register_files(merger->ring, 2 * MERGE_REQUESTS) == -1) {
+        perror((merger->ring == NULL) ? "io_uring_setup()" : "io_uring_register()");
+        if (merger->ring != NULL) uring_destroy(merger->ring);
+        merger->ring = NULL;
+        return 0;
+    }
+    // Kernels before 5.15 have io_uring, but neither mkdirat() nor opens into slots
+    if (!uring_supports(merger->ring, opcodes, sizeof(opcodes)) || !uring_supports_direct_open(merger->ring)) {
+        fprintf(stderr, "io_uring lacks the requests that create entries\n");
+        uring_destroy(merger->ring);
+        merger->ring = NULL;
+        return 0;
+    }
+    // Page aligned buffers let the kernel copy whole pages
+    if (posix_memalign((void **)&merger->buffers, 4096, (size_t)MERGE_REQUESTS * URING_COPY_MAX) != 0) {
+        fprintf(stderr, "posix_memalign() failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < MERGE_REQUESTS; i++) merger->requests[i].buffer = merger->buffers + (size_t)i * URING_COPY_MAX;
+    merger->directories = 0;
+    merger->freeCount = MERGE_REQUESTS;
+    for (int i = 0; i < MERGE_REQUESTS; i++) merger->freeRequests[i] = MERGE_REQUESTS - 1 - i;
+    return 1;
+}
+
+Merger *merger_create(void) {
+    Merger *merger = malloc(sizeof(*merger));
+    NULL_CHECK(merger, "malloc");
+    merger->pool = NULL;
+    merger->directoryBatch = NULL;
+    merger->fileBatch = NULL;
+    pthread_mutex_init(&merger->lock, NULL);
+    pthread_cond_init(&merger->released, NULL);
+    merger->batches = 0;
+    merger->maxBatches = MERGE_BATCHES_PER_WORKER * info->options.mergeThreads;
+    merger->pendingDirectories = 0;
+    merger->ring = NULL;
+    merger->buffers = NULL;
+
+    if (info->options.mergeBackend == MERGE_URING) {
+        if (merger_uring_init(merger)) return merger;
+        // Fall back to the synchronous backend if io_uring can't be used
+        fprintf(stderr, "io_uring is not available, falling back to --merge=sync\n");
+    }
+    // With a single thread, the calling thread creates the entries as they come
+    if (info->options.mergeThreads > 1) merger->pool = pool_create(info->options.mergeThreads);
+    return merger;
+}
+
+// Copy a file again, synchronously, after its chain of requests broke. Fails the way copy_file() would
+static void copy_again(EntryInfo *entry, char *destination) {
+    stats_count(COUNT_OPEN, 1);
+    int toFd = open(destination, O_CREAT | O_TRUNC | O_WRONLY, entry->perms);
+    if (toFd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    int fromFd = entry_open(entry);
+    copy_contents(fromFd, toFd, entry->size);
+    if (close(fromFd) == -1 || close(toFd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Finish an entry, once every request of it has completed
+static void request_finish(Merger *merger, int index) {
+    Request *request = &merger->requests[index];
+    if (request->entry.fileType == DIRECTORY) {
+        merger->directories--;
+        // If another entry with the same name was already created, don't create this directory
+        if (request->error != 0 && request->error != EEXIST) {
+            errno = request->error;
+            perror("mkdir()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        // A broken chain leaves the files it opened in their slots
+        int slotTo = 2 * index, slotFrom = 2 * index + 1;
+        if ((request->done & (1 << STEP_OPEN_TO)) && !(request->done & (1 << STEP_CLOSE_TO))) uring_release_file(merger->ring, slotTo);
+        if ((request->done & (1 << STEP_OPEN_FROM)) && !(request->done & (1 << STEP_CLOSE_FROM))) uring_release_file(merger->ring, slotFrom);
+
+        // The chain only reaches its last step if every other step succeeded
+        if (request->done & (1 << STEP_CLOSE_TO)) copy_count(COPY_URING, request->entry.size);
+        else if (request->failedStep == STEP_OPEN_TO) {
+            // Same as copy_file(): an existing file is not re-created, and a file whose
+            // parent directory was not copied is ignored
+            if (request->error != EEXIST && request->error != ENOTDIR) {
+                errno = request->error;
+                perror("open()");
+                exit(EXIT_FAILURE);
+            }
+        }
+        // The new file exists, but its contents could not be copied through io_uring, e.g.
+        // because the old file changed since it was scanned. Leave it to the synchronous path
+        else copy_again(&request->entry, request->destination);
+    }
+    free(request->destination);
+    merger->freeRequests[merger->freeCount++] = index;
+}
+
+// Collect the completed requests. If 'wait' is true, waits for at least one
+static void merger_reap(Merger *merger, int wait) {
+    struct io_uring_cqe cqe;
+    while (uring_get_cqe(merger->ring, &cqe, wait)) {
+        wait = 0;
+        int index = (int)(cqe.user_data >> STEP_BITS), step = (int)(cqe.user_data & ((1 << STEP_BITS) - 1));
+        Request *request = &merger->requests[index];
+        // Reads and writes must move the whole file. A short one breaks the chain, like an error
+        int succeeded = (step == STEP_READ || step == STEP_WRITE) ? cqe.res == (int)request->entry.size : cqe.res >= 0;
+        if (succeeded) request->done |= 1 << step;
+        // Requests after the one that failed are canceled
+        else if (request->error == 0 && cqe.res != -ECANCELED) {
+            request->error = (cqe.res < 0) ? -cqe.res : -1;
+            request->failedStep = step;
+        }
+        if (--request->pending == 0) request_finish(merger, index);
+    }
+}
+
+// Take a free request for given entry, and make room for its submission entries
+static int request_take(Merger *merger, EntryInfo *entry, int steps) {
+    while (merger->freeCount == 0) merger_reap(merger, 1);
+    if (uring_sq_space(merger->ring) < (unsigned int)steps) uring_submit(merger->ring, 0);
+
+    int index = merger->freeRequests[--merger->freeCount];
+    Request *request = &merger->requests[index];
+    request->entry = *entry;
+    request->destination = concatinate(info->hierarchyC, entry->relativeToHier);
+    request->pending = steps;
+    request->done = 0;
+    request->error = 0;
+    request->failedStep = -1;
+    return index;
+}
+
+// Prepare the request of given step. Every request but the last of an entry is linked to the next one
+static struct io_uring_sqe *request_step(Merger *merger, int index, int step, int last) {
+    struct io_uring_sqe *sqe = uring_get_sqe(merger->ring);
+    sqe->user_data = ((unsigned long)index << STEP_BITS) | step;
+    if (!last) sqe->flags |= IOSQE_IO_LINK;
+    return sqe;
+}
+
+static void queue_directory(Merger *merger, EntryInfo *entry) {
+    int index = request_take(merger, entry, 1);
+    struct io_uring_sqe *sqe = request_step(merger, index, STEP_MKDIR, 1);
+    sqe->opcode = IORING_OP_MKDIRAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long)merger->requests[index].destination;
+    sqe->len = entry->perms;
+    merger->directories++;
+}
+
+static void queue_copy(Merger *merger, EntryInfo *entry) {
+    int empty = (entry->size == 0);
+    int index = request_take(merger, entry, empty ? 2 : 6);
+    Request *request = &merger->requests[index];
+    unsigned int slotTo = 2 * index, slotFrom = 2 * index + 1;
+
+    // Create the new file first, so that nothing else runs if it already exists
+    stats_count(COUNT_OPEN, empty ? 1 : 2);
+    struct io_uring_sqe *sqe = request_step(merger, index, STEP_OPEN_TO, 0);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long)request->destination;
+    sqe->open_flags = O_CREAT | O_EXCL | O_WRONLY;
+    sqe->len = entry->perms;
+    sqe->file_index = slotTo + 1;
+
+    if (!empty) {
+        sqe = request_step(merger, index, STEP_OPEN_FROM, 0);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)entry->relativePath;
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = slotFrom + 1;
+
+        sqe = request_step(merger, index, STEP_READ, 0);
+        sqe->opcode = IORING_OP_READ;
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->fd = slotFrom;
+        sqe->addr = (unsigned long)request->buffer;
+        sqe->len = entry->size;
+        sqe->off = 0;
+
+        sqe = request_step(merger, index, STEP_WRITE, 0);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->fd = slotTo;
+        sqe->addr = (unsigned long)request->buffer;
+        sqe->len = entry->size;
+        sqe->off = 0;
+
+        sqe = request_step(merger, index, STEP_CLOSE_FROM, 0);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = slotFrom + 1;
+    }
+
+    sqe = request_step(merger, index, STEP_CLOSE_TO, 1);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slotTo + 1;
+}
+
+// Task of a worker: Create every entry of a batch
+static void batch_create(void *arg) {
+    Batch *batch = arg;
+    Merger *merger = batch->merger;
+    for (int k = 0; k < batch->count; k++) create_entry(&batch->entries[k]);
+
+    pthread_mutex_lock(&merger->lock);
+    merger->batches--;
+    merger->pendingDirectories -= batch->directories;
+    pthread_cond_broadcast(&merger->released);
+    pthread_mutex_unlock(&merger->lock);
+    free(batch);
+}
+
+// Submit a batch being filled to the workers, once fewer than the limit of batches are in flight
+static void batch_flush(Merger *merger, Batch **batchPtr) {
+    Batch *batch = *batchPtr;
+    if (batch == NULL) return;
+    *batchPtr = NULL;
+
+    pthread_mutex_lock(&merger->lock);
+    while (merger->batches >= merger->maxBatches) pthread_cond_wait(&merger->released, &merger->lock);
+    merger->batches++;
+    merger->pendingDirectories += batch->directories;
+    pthread_mutex_unlock(&merger->lock);
+    pool_submit(merger->pool, batch_create, batch);
+}
+
+// Queue given entry to be created by a worker
+static void batch_add(Merger *merger, EntryInfo *entry) {
+    Batch **batchPtr = (entry->fileType == DIRECTORY) ? &merger->directoryBatch : &merger->fileBatch;
+    if (*batchPtr == NULL) {
+        *batchPtr = malloc(sizeof(**batchPtr));
+        NULL_CHECK(*batchPtr, "malloc");
+        (*batchPtr)->merger = merger;
+        (*batchPtr)->count = 0;
+        (*batchPtr)->directories = 0;
+    }
+    Batch *batch = *batchPtr;
+    batch->entries[batch->count++] = *entry;
+    if (entry->fileType == DIRECTORY) batch->directories++;
+    if (batch->count == MERGE_BATCH) batch_flush(merger, batchPtr);
+}
+
+void merger_add(Merger *merger, EntryInfo *entry) {
+    if (merger->pool != NULL) {
+        batch_add(merger, entry);
+        return;
+    }
+    if (merger->ring != NULL) {
+        if (entry->fileType == DIRECTORY) {
+            queue_directory(merger, entry);
+            return;
+        }
+        if (entry->fileType == REGFILE && entry->size <= URING_COPY_MAX) {
+            queue_copy(merger, entry);
+            return;
+        }
+        // Let the queued requests run while this entry is created
+        uring_submit(merger->ring, 0);
+    }
+    create_entry(entry);
+}
+
+void merger_barrier(Merger *merger) {
+    if (merger->pool != NULL) {
+        batch_flush(merger, &merger->directoryBatch);
+        pthread_mutex_lock(&merger->lock);
+        while (merger->pendingDirectories > 0) pthread_cond_wait(&merger->released, &merger->lock);
+        pthread_mutex_unlock(&merger->lock);
+        return;
+    }
+    if (merger->ring == NULL) return;
+    while (merger->directories > 0) merger_reap(merger, 1);
+}
+
+void merger_wait(Merger *merger) {
+    if (merger->pool != NULL) {
+        batch_flush(merger, &merger->directoryBatch);
+        batch_flush(merger, &merger->fileBatch);
+        pool_wait(merger->pool);
+    }
+    if (merger->ring != NULL) {
+        while (merger->freeCount < MERGE_REQUESTS) merger_reap(merger, 1);
+    }
+}
+
+void merger_destroy(Merger *merger) {
+    merger_wait(merger);
+    if (merger->pool != NULL) pool_destroy(merger->pool);
+    if (merger->ring != NULL) uring_destroy(merger->ring);
+    pthread_mutex_destroy(&merger->lock);
+    pthread_cond_destroy(&merger->released);
+    free(merger->buffers);
+    free(merger);
+}
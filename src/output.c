@@ -0,0 +1,256 @@
+#include <pthread.h>        // pthread_create() etc.
+#include <stdio.h>          // snprintf() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strlen() etc.
+#include <unistd.h>         // STDOUT_FILENO
+
+#include "cat_manager.h"    // MISSING etc.
+#include "info.h"           // GlobalInfo
+#include "output.h"
+#include "utils.h"          // fullwrite() etc.
+
+// Size of every buffer of formatted differences
+#define OUTPUT_BUFFER (1024 * 1024)
+// Number of buffers. Without a writer thread only the first one is used
+#define OUTPUT_BUFFERS 4
+
+// Changes of a difference, as written by the watch mode
+#define CHANGE_NONE  0
+#define CHANGE_ADDED '+'
+
+extern GlobalInfo *info;
+
+typedef struct {
+    char *data;
+    size_t len;
+} Buffer;
+
+// The buffers form a ring. Buffer (filled % OUTPUT_BUFFERS) is being formatted into, and the
+// buffers from (written % OUTPUT_BUFFERS) up to it are waiting for the writer thread
+static Buffer buffers[OUTPUT_BUFFERS];
+static char format;
+static int threaded;
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Protects the counters below
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;   // Signaled when a buffer is handed to the writer, or on shutdown
+static pthread_cond_t released = PTHREAD_COND_INITIALIZER; // Signaled when the writer is done with a buffer
+static unsigned long filled = 0;    // Buffers handed to the writer
+static unsigned long written = 0;   // Buffers written by the writer
+static int stopping = 0;            // Whether the writer exits once every buffer is written
+
+// Writer thread: Write every buffer handed to it, in order
+static void *writer_run(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while (1) {
+        while (written == filled && !stopping) pthread_cond_wait(&queued, &lock);
+        if (written == filled) break;
+        Buffer *buffer = &buffers[written % OUTPUT_BUFFERS];
+        pthread_mutex_unlock(&lock);
+        fullwrite(STDOUT_FILENO, buffer->data, buffer->len);
+        buffer->len = 0;
+        pthread_mutex_lock(&lock);
+        written++;
+        pthread_cond_signal(&released);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void output_init(void) {
+    format = info->options.format;
+    threaded = info->options.outputThread;
+    for (int i = 0; i < (threaded ? OUTPUT_BUFFERS : 1); i++) {
+        buffers[i].data = malloc(OUTPUT_BUFFER);
+        NULL_CHECK(buffers[i].data, "malloc");
+        buffers[i].len = 0;
+    }
+    if (threaded && pthread_create(&writer, NULL, writer_run, NULL) != 0) {
+        perror("pthread_create()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Write the buffer being formatted into, or hand it to the writer thread and move on to the next one
+static void buffer_release(void) {
+    if (!threaded) {
+        fullwrite(STDOUT_FILENO, buffers[0].data, buffers[0].len);
+        buffers[0].len = 0;
+        return;
+    }
+    if (buffers[filled % OUTPUT_BUFFERS].len == 0) return;
+    pthread_mutex_lock(&lock);
+    filled++;
+    pthread_cond_signal(&queued);
+    // The next buffer may still be waiting for the writer
+    while (filled - written >= OUTPUT_BUFFERS) pthread_cond_wait(&released, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+// Append 'len' bytes to the output
+static void put(const char *data, size_t len) {
+    while (len > 0) {
+        Buffer *buffer = &buffers[threaded ? filled % OUTPUT_BUFFERS : 0];
+        size_t n = (len < OUTPUT_BUFFER - buffer->len) ? len : OUTPUT_BUFFER - buffer->len;
+        memcpy(buffer->data + buffer->len, data, n);
+        buffer->len += n;
+        data += n;
+        len -= n;
+        if (buffer->len == OUTPUT_BUFFER) buffer_release();
+    }
+}
+
+static void put_string(const char *string) {
+    put(string, strlen(string));
+}
+
+// Returns the length of the valid UTF-8 sequence that starts at 's', or 0 if it is not valid
+static size_t utf8_length(const unsigned char *s) {
+    size_t len = (s[0] >= 0xC2 && s[0] <= 0xDF) ? 2 : (s[0] >= 0xE0 && s[0] <= 0xEF) ? 3 : (s[0] >= 0xF0 && s[0] <= 0xF4) ? 4 : 0;
+    for (size_t k = 1; k < len; k++) {
+        if ((s[k] & 0xC0) != 0x80) return 0;
+    }
+    return len;
+}
+
+// Append a string as a JSON string. Control characters, and bytes that are not valid UTF-8, are escaped
+static void put_json(const char *string) {
+    put("\"", 1);
+    const unsigned char *s = (const unsigned char *)string;
+    while (*s != '\0') {
+        // Copy the longest run that needs no escape at once
+        const unsigned char *run = s;
+        size_t len;
+        while (*s >= 0x20 && *s != '"' && *s != '\\') {
+            if (*s < 0x80) s++;
+            else if ((len = utf8_length(s)) != 0) s += len;
+            else break;
+        }
+        put((const char *)run, s - run);
+        if (*s == '\0') break;
+
+        char escape[8];
+        if (*s == '"' || *s == '\\') snprintf(escape, sizeof(escape), "\\%c", *s);
+        else snprintf(escape, sizeof(escape), "\\u%04x", *s);
+        put_string(escape);
+        s++;
+    }
+    put("\"", 1);
+}
+
+static const char *type_name(char fileType) {
+    switch (fileType) {
+        case REGFILE:   return "file";
+        case DIRECTORY: return "directory";
+        case HARDLINK:  return "hardlink";
+        default:        return "symlink";
+    }
+}
+
+// Name of the reason why an entry is a difference
+static const char *reason_name(EntryInfo *entry, EntryInfo *partner, char verdict) {
+    if (verdict == MISSING || partner == NULL) return "missing";
+    if (verdict == MISMATCH) return "type-mismatch";
+    return (entry->size != partner->size) ? "size" : "content";
+}
+
+// Append a difference in the chosen format. 'change' is one of the #defines listed above
+static void put_difference(EntryInfo *entry, EntryInfo *partner, char verdict, char change) {
+    char side[2] = {entry->fromHierarchy, '\0'};
+    char number[32];
+    if (format == FORMAT_TEXT) {
+        if (change != CHANGE_NONE) put(&change, 1);
+        put("\t", 1);
+        put_string(entry->relativePath);
+        put("\n", 1);
+    }
+    else if (format == FORMAT_JSONL) {
+        put_string((change == CHANGE_ADDED) ? "{\"change\":\"added\",\"side\":\"" : "{\"side\":\"");
+        put_string(side);
+        put_string("\",\"path\":");
+        put_json(entry->relativePath);
+        put_string(",\"type\":\"");
+        put_string(type_name(entry->fileType));
+        put_string("\",\"reason\":\"");
+        put_string(reason_name(entry, partner, verdict));
+        snprintf(number, sizeof(number), "\",\"size\":%lld", (long long)entry->size);
+        put_string(number);
+        if (partner != NULL) {
+            snprintf(number, sizeof(number), ",\"otherSize\":%lld", (long long)partner->size);
+            put_string(number);
+        }
+        put_string("}\n");
+    }
+    else {
+        if (change != CHANGE_NONE) put_string("+\t");
+        put_string(side);
+        put("\t", 1);
+        put_string(type_name(entry->fileType));
+        put("\t", 1);
+        put_string(reason_name(entry, partner, verdict));
+        snprintf(number, sizeof(number), "\t%lld\t", (long long)entry->size);
+        put_string(number);
+        if (partner != NULL) {
+            snprintf(number, sizeof(number), "%lld", (long long)partner->size);
+            put_string(number);
+        }
+        put("\t", 1);
+        put(entry->relativePath, strlen(entry->relativePath) + 1);
+    }
+}
+
+void output_header(char fromHierarchy) {
+    if (format == FORMAT_TEXT) put_string((fromHierarchy == HIER_A) ? "In pathA :\n" : "In pathB :\n");
+}
+
+void output_difference(EntryInfo *entry, EntryInfo *partner, char verdict) {
+    put_difference(entry, partner, verdict, CHANGE_NONE);
+}
+
+void output_added(EntryInfo *entry, EntryInfo *partner, char verdict) {
+    put_difference(entry, partner, verdict, CHANGE_ADDED);
+}
+
+void output_resolved(char fromHierarchy, char *relativePath) {
+    char side[2] = {fromHierarchy, '\0'};
+    if (format == FORMAT_TEXT) {
+        put("-\t", 2);
+        put_string(relativePath);
+        put("\n", 1);
+    }
+    else if (format == FORMAT_JSONL) {
+        put_string("{\"change\":\"resolved\",\"side\":\"");
+        put_string(side);
+        put_string("\",\"path\":");
+        put_json(relativePath);
+        put_string("}\n");
+    }
+    else {
+        // The fields that describe the entry are left empty
+        put_string("-\t");
+        put_string(side);
+        put("\t\t\t\t\t", 5);
+        put(relativePath, strlen(relativePath) + 1);
+    }
+}
+
+void output_flush(void) {
+    buffer_release();
+}
+
+void output_destroy(void) {
+    buffer_release();
+    if (!threaded) {
+        free(buffers[0].data);
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+    if (pthread_join(writer, NULL) != 0) {
+        perror("pthread_join()");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < OUTPUT_BUFFERS; i++) free(buffers[i].data);
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>          // fprintf() etc.
+#include <stdlib.h>         // malloc() etc.
+
+#include "entry_manager.h"  // create_entry() etc.
+#include "info.h"           // GlobalInfo
+#include "linktable.h"      // LinkTable
+#include "merger.h"         // Merger
+#include "plan.h"
+#include "utils.h"          // NULL_CHECK() etc.
+
+extern GlobalInfo *info;
+
+static const char *kindNames[OP_KINDS] = {"mkdir", "copy", "link", "symlink"};
+
+// Returns the position of given kind in the order of execution
+static int kind_rank(char kind) {
+    switch (kind) {
+        case OP_MKDIR: return 0;
+        case OP_COPY: return 1;
+        case OP_LINK: return 2;
+        default: return 3;
+    }
+}
+
+// Order operations the way they are executed
+static int compare_operations(const void *a, const void *b) {
+    const Operation *opA = a, *opB = b;
+    int rankA = kind_rank(opA->kind), rankB = kind_rank(opB->kind);
+    if (rankA != rankB) return rankA - rankB;
+    // Copies follow their sources on the devices
+    if (opA->kind == OP_COPY) {
+        if (opA->device != opB->device) return (opA->device > opB->device) - (opA->device < opB->device);
+        if (opA->inode != opB->inode) return (opA->inode > opB->inode) - (opA->inode < opB->inode);
+    }
+    // Everything else goes level by level
+    if (opA->level != opB->level) return opA->level - opB->level;
+    if (opA->fromHierarchy != opB->fromHierarchy) return opA->fromHierarchy - opB->fromHierarchy;
+    return opA->position - opB->position;
+}
+
+// Plan the creation of the entry in position i of a catalog, in given level. 'directories' tells which entries of the
+// catalog are directories in hierarchyC, and 'copies' holds the hardlinked files already copied. Returns true if the
+// entry is a directory in hierarchyC
+static int plan_entry(MergePlan *plan, ArrayWrapper *wrapper, int i, int level, char *directories, LinkTable *copies) {
+    // Same as create_entry(): an entry whose parent directory was not copied is ignored
+    if (wrapper->parents[i] != -1 && !directories[wrapper->parents[i]]) return 0;
+
+    Operation *op = &plan->ops[plan->count++];
+    op->device = wrapper->devices[i];
+    op->inode = wrapper->inodes[i];
+    op->target = NULL;
+    op->position = i;
+    op->level = level;
+    op->fromHierarchy = wrapper->fromHierarchy;
+    if (wrapper->types[i] == DIRECTORY) op->kind = OP_MKDIR;
+    else if (wrapper->types[i] == SYMLINK) op->kind = OP_SYMLINK;
+    // Only the first name of a hardlinked file is copied. Its other names are linked to the copy
+    else if (wrapper->types[i] == HARDLINK && (op->target = link_table_find(copies, op->device, op->inode)) != NULL) op->kind = OP_LINK;
+    else {
+        if (wrapper->types[i] == HARDLINK) link_table_insert(copies, op->device, op->inode, wrapper->links[i], wrapper_path(wrapper, i));
+        op->kind = OP_COPY;
+        plan->bytes += wrapper->sizes[i];
+    }
+    plan->kindCounts[kind_rank(op->kind)]++;
+    return op->kind == OP_MKDIR;
+}
+
+MergePlan *plan_create(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB, VerdictTable *table) {
+    MergePlan *plan = malloc(sizeof(*plan));
+    NULL_CHECK(plan, "malloc");
+    plan->wrapperA = wrapperA;
+    plan->wrapperB = wrapperB;
+    // Every entry of hierarchyC is created by a single operation, from a single entry of A or B
+    plan->ops = malloc((wrapperA->size + wrapperB->size + 1) * sizeof(*plan->ops));
+    NULL_CHECK(plan->ops, "malloc");
+    plan->count = 0;
+    for (int k = 0; k < OP_KINDS; k++) plan->kindCounts[k] = 0;
+    plan->bytes = 0;
+
+    // Whether the path of every entry is a directory in hierarchyC. Both entries of a pair have the same path
+    char *directoriesA = calloc(wrapperA->size + 1, sizeof(*directoriesA));
+    NULL_CHECK(directoriesA, "calloc");
+    char *directoriesB = calloc(wrapperB->size + 1, sizeof(*directoriesB));
+    NULL_CHECK(directoriesB, "calloc");
+    LinkTable *copies = link_table_create();
+
+    // Plan level by level, so that the parent of every entry is decided before it
+    int lastLevel = (wrapperA->lastLevel > wrapperB->lastLevel) ? wrapperA->lastLevel : wrapperB->lastLevel;
+    for (int level = 0; level <= lastLevel; level++) {
+        if (level <= wrapperA->lastLevel) {
+            for (int i = wrapperA->levels[level]; i < wrapperA->levels[level+1]; i++) {
+                int j = table->partnersA[i];
+                // If 2 entries have the same name, keep the newest one. If A and B
+                // have the same modified time, keep B. Otherwise entryA is unique
+                if (j != -1 && wrapperA->mtimes[i] <= wrapperB->mtimes[j]) directoriesA[i] = plan_entry(plan, wrapperB, j, level, directoriesB, copies);
+                else directoriesA[i] = plan_entry(plan, wrapperA, i, level, directoriesA, copies);
+                if (j != -1) directoriesB[j] = directoriesA[i];
+            }
+        }
+        if (level <= wrapperB->lastLevel) {
+            // Pairs were already handled above. Only plan the unique entries of B
+            for (int j = wrapperB->levels[level]; j < wrapperB->levels[level+1]; j++) {
+                if (table->partnersB[j] == -1) directoriesB[j] = plan_entry(plan, wrapperB, j, level, directoriesB, copies);
+            }
+        }
+    }
+    link_table_destroy(copies);
+    free(directoriesA);
+    free(directoriesB);
+
+    qsort(plan->ops, plan->count, sizeof(*plan->ops), compare_operations);
+    return plan;
+}
+
+void plan_report(MergePlan *plan, FILE *stream) {
+    fprintf(stream, "Merge plan:\n");
+    for (int k = 0; k < OP_KINDS; k++) {
+        fprintf(stream, "\t%-8s %12lu ops %16lu bytes\n", kindNames[k], plan->kindCounts[k], (k == kind_rank(OP_COPY)) ? plan->bytes : 0);
+    }
+    fprintf(stream, "\t%-8s %12d ops %16lu bytes\n", "total", plan->count, plan->bytes);
+}
+
+// Fill 'entry' with the fields of the source of an operation
+static void operation_entry(MergePlan *plan, Operation *op, EntryInfo *entry) {
+    wrapper_entry((op->fromHierarchy == HIER_A) ? plan->wrapperA : plan->wrapperB, op->position, entry);
+}
+
+void plan_execute(MergePlan *plan) {
+    Merger *merger = merger_create();
+    EntryInfo entry;
+    int k = 0;
+
+    // Every directory of a level is created before the directories of the next one
+    for (int level = 0; k < plan->count && plan->ops[k].kind == OP_MKDIR; k++) {
+        if (plan->ops[k].level != level) {
+            merger_barrier(merger);
+            level = plan->ops[k].level;
+        }
+        operation_entry(plan, &plan->ops[k], &entry);
+        merger_add(merger, &entry);
+    }
+    merger_barrier(merger);
+
+    // The first name of a hardlinked file is copied like any other file, as its other names are linked below
+    for (; k < plan->count && plan->ops[k].kind == OP_COPY; k++) {
+        operation_entry(plan, &plan->ops[k], &entry);
+        entry.fileType = REGFILE;
+        merger_add(merger, &entry);
+    }
+    merger_destroy(merger);
+
+    // Every file that a link points to exists by now
+    for (; k < plan->count; k++) {
+        operation_entry(plan, &plan->ops[k], &entry);
+        if (plan->ops[k].kind == OP_SYMLINK) {
+            create_entry(&entry);
+            continue;
+        }
+        char *target = concatinate(info->hierarchyC, plan->ops[k].target);
+        char *destination = concatinate(info->hierarchyC, entry.relativeToHier);
+        link_file(target, destination);
+        free(target);
+        free(destination);
+    }
+}
+
+void plan_destroy(MergePlan *plan) {
+    for (int k = 0; k < plan->count; k++) free(plan->ops[k].target);
+    free(plan->ops);
+    free(plan);
+}
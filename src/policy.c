@@ -0,0 +1,214 @@
+#include <stdatomic.h>      // atomic_ulong etc.
+#include <stdio.h>          // fprintf() etc.
+#include <stdlib.h>         // exit() etc.
+#include <string.h>         // strcmp() etc.
+#include <unistd.h>         // pread() etc.
+
+#include "cat_manager.h"    // SAME etc.
+#include "compare.h"        // compare_files() etc.
+#include "info.h"           // GlobalInfo
+#include "policy.h"
+#include "sigcache.h"       // cache_lookup() etc.
+#include "stats.h"          // stats_count()
+
+// Bytes read from the start and from the end of both files by the sample tier
+#define SAMPLE_LEN (16 * 1024)
+
+extern GlobalInfo *info;
+
+// Names of the tiers, as given in the command line and as reported
+static const char *tierNames[TIER_COUNT] = {"tree", "inode", "size", "mtime", "cache", "sample", "full", "symlink"};
+
+// Pairs decided by every tier, and the bytes of the files of those pairs
+static atomic_ulong tierPairs[TIER_COUNT];
+static atomic_ulong tierBytes[TIER_COUNT];
+
+unsigned int policy_parse(char *list) {
+    unsigned int tiers = 0;
+    for (char *name = list; ; name++) {
+        size_t len = strcspn(name, ",");
+        int tier;
+        for (tier = 0; tier < TIER_COUNT; tier++) {
+            if (strlen(tierNames[tier]) == len && !strncmp(name, tierNames[tier], len)) break;
+        }
+        if (tier == TIER_COUNT || !(TIER_BIT(tier) & TIER_OPTIONAL)) return 0;
+        tiers |= TIER_BIT(tier);
+        name += len;
+        if (*name == '\0') break;
+    }
+    return tiers;
+}
+
+// Count a pair of files of 'size' bytes each as decided by given tier, and return its verdict
+static char decided(int tier, off_t size, char verdict) {
+    atomic_fetch_add_explicit(&tierPairs[tier], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tierBytes[tier], 2 * size, memory_order_relaxed);
+    // The pairs of the tree tier are counted by policy_tree_verdict(), which knows their types
+    if (tier == TIER_INODE || tier == TIER_SIZE || tier == TIER_MTIME || tier == TIER_CACHE) stats_count(COUNT_AVOIDED, 1);
+    return verdict;
+}
+
+// Decide the verdict of a pair of same-name entries from their metadata alone
+static char metadata_verdict(EntryInfo *entryA, EntryInfo *entryB) {
+    stats_count(COUNT_PAIRS, 1);
+    unsigned int tiers = info->options.tiers;
+    char type = entryA->fileType;
+    // Entries with the same name but different types are never the same
+    if (type != entryB->fileType) return MISMATCH;
+    // Directories with the same name are always the same
+    if (type == DIRECTORY) return SAME;
+    if (type == SYMLINK) return PENDING;
+
+    off_t size = entryA->size;
+    if ((tiers & TIER_BIT(TIER_INODE)) && entryA->inode == entryB->inode && entryA->device == entryB->device) {
+        return decided(TIER_INODE, size, SAME);
+    }
+    if (size != entryB->size) return decided(TIER_SIZE, 0, DIFFERENT);
+    if (size == 0) return decided(TIER_SIZE, 0, SAME);
+    if ((tiers & TIER_BIT(TIER_MTIME)) && entryA->mtime == entryB->mtime && entryA->mtimeNsec == entryB->mtimeNsec) {
+        return decided(TIER_MTIME, size, SAME);
+    }
+    return PENDING;
+}
+
+int policy_subtrees_same(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j) {
+    unsigned char *digestA = wrapper_digest(wrapperA, i), *digestB = wrapper_digest(wrapperB, j);
+    return digestA != NULL && digestB != NULL && !memcmp(digestA, digestB, SHA256_LEN);
+}
+
+char policy_tree_verdict(ArrayWrapper *wrapper, int i) {
+    stats_count(COUNT_PAIRS, 1);
+    if (wrapper->types[i] == DIRECTORY) return decided(TIER_TREE, 0, SAME);
+    stats_count(COUNT_AVOIDED, 1);
+    return decided(TIER_TREE, wrapper->sizes[i], SAME);
+}
+
+char policy_metadata_verdict(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j) {
+    EntryInfo entryA, entryB;
+    wrapper_entry(wrapperA, i, &entryA);
+    wrapper_entry(wrapperB, j, &entryB);
+    return metadata_verdict(&entryA, &entryB);
+}
+
+// Read up to 'len' bytes found at 'offset'. Less bytes are only read if the file ends first
+static size_t read_at(int fd, char *buffer, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = pread(fd, buffer + total, len - total, offset + total);
+        if (n == -1) {
+            perror("pread()");
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    stats_count(COUNT_READ, total);
+    return total;
+}
+
+// Returns true if the 'len' bytes found at 'offset' differ between 2 files
+static int sample_differs(int fdA, int fdB, off_t offset) {
+    char bufA[SAMPLE_LEN], bufB[SAMPLE_LEN];
+    size_t nA = read_at(fdA, bufA, SAMPLE_LEN, offset);
+    size_t nB = read_at(fdB, bufB, SAMPLE_LEN, offset);
+    return nA != nB || first_difference(bufA, bufB, nA) != nA;
+}
+
+// Store the content signature of a regular file in 'digest', either from 'known' (the signature that its
+// manifest holds, if any) or from the signature cache. Returns false if neither knows it
+static int signature(unsigned char *known, EntryInfo *entry, unsigned char digest[SHA256_LEN]) {
+    if (known != NULL) {
+        memcpy(digest, known, SHA256_LEN);
+        return 1;
+    }
+    return info->cache != NULL && cache_lookup(info->cache, entry, digest);
+}
+
+// Decide the verdict of a pair left PENDING by its metadata, by reading the entries. 'knownA' and 'knownB'
+// are the signatures of the entries that their manifests hold, or NULL. Returns VANISHED if either entry
+// was removed since it was stat'ed
+static char contents_verdict(EntryInfo *entryA, unsigned char *knownA, EntryInfo *entryB, unsigned char *knownB) {
+    if (entryA->fileType == SYMLINK) {
+        int areSame = symlinks_are_same(entryA, entryB);
+        if (areSame == -1) return VANISHED;
+        return decided(TIER_SYMLINK, 0, areSame ? SAME : DIFFERENT);
+    }
+
+    off_t size = entryA->size;
+    unsigned char digestA[SHA256_LEN], digestB[SHA256_LEN];
+    if (signature(knownA, entryA, digestA) && signature(knownB, entryB, digestB)) {
+        return decided(TIER_CACHE, size, memcmp(digestA, digestB, SHA256_LEN) ? DIFFERENT : SAME);
+    }
+
+    int fdA = entry_try_open(entryA);
+    if (fdA == -1) return VANISHED;
+    int fdB = entry_try_open(entryB);
+    if (fdB == -1) {
+        if (close(fdA) == -1) {
+            perror("close()");
+            exit(EXIT_FAILURE);
+        }
+        return VANISHED;
+    }
+    char verdict;
+    // Files that were changed in place often differ at their start (headers) or at their end (appends)
+    // NOTE: Small files are cheaper to compare in whole
+    if ((info->options.tiers & TIER_BIT(TIER_SAMPLE)) && size > 4 * SAMPLE_LEN &&
+        (sample_differs(fdA, fdB, 0) || sample_differs(fdA, fdB, size - SAMPLE_LEN))) {
+        verdict = decided(TIER_SAMPLE, size, DIFFERENT);
+    }
+    // With a signature cache, the signatures of both files are computed, so that they can be reused in later runs
+    else if (info->cache != NULL) {
+        cache_digest(info->cache, entryA, fdA, digestA);
+        cache_digest(info->cache, entryB, fdB, digestB);
+        verdict = decided(TIER_FULL, size, memcmp(digestA, digestB, SHA256_LEN) ? DIFFERENT : SAME);
+    }
+    else verdict = decided(TIER_FULL, size, (compare_files(fdA, fdB, size) == -1) ? SAME : DIFFERENT);
+
+    if (close(fdA) == -1 || close(fdB) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    return verdict;
+}
+
+// Exit if a pair, whose entries must not change while they are compared, vanished
+static char settled(char verdict, EntryInfo *entryA) {
+    if (verdict == VANISHED) {
+        fprintf(stderr, "%s vanished while being compared\n", entryA->relativeToHier);
+        exit(EXIT_FAILURE);
+    }
+    return verdict;
+}
+
+char policy_contents_verdict(ArrayWrapper *wrapperA, int i, ArrayWrapper *wrapperB, int j) {
+    EntryInfo entryA, entryB;
+    wrapper_entry(wrapperA, i, &entryA);
+    wrapper_entry(wrapperB, j, &entryB);
+    return settled(contents_verdict(&entryA, wrapper_digest(wrapperA, i), &entryB, wrapper_digest(wrapperB, j)), &entryA);
+}
+
+char policy_live_verdict(EntryInfo *entryA, EntryInfo *entryB) {
+    char verdict = metadata_verdict(entryA, entryB);
+    return (verdict == PENDING) ? contents_verdict(entryA, NULL, entryB, NULL) : verdict;
+}
+
+char policy_entries_verdict(EntryInfo *entryA, EntryInfo *entryB) {
+    return settled(policy_live_verdict(entryA, entryB), entryA);
+}
+
+void policy_report(FILE *stream, int json) {
+    if (json) {
+        for (int tier = 0; tier < TIER_COUNT; tier++) {
+            fprintf(stream, "%s\"%s\":{\"pairs\":%lu,\"bytes\":%lu}", (tier == 0) ? "{" : ",", tierNames[tier],
+                    atomic_load(&tierPairs[tier]), atomic_load(&tierBytes[tier]));
+        }
+        fprintf(stream, "}");
+        return;
+    }
+    fprintf(stream, "Comparison tiers:\n");
+    for (int tier = 0; tier < TIER_COUNT; tier++) {
+        fprintf(stream, "\t%-8s %12lu pairs %16lu bytes\n", tierNames[tier],
+                atomic_load(&tierPairs[tier]), atomic_load(&tierBytes[tier]));
+    }
+}
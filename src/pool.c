@@ -0,0 +1,205 @@
+#include <pthread.h>    // pthread_create() etc.
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc() etc.
+
+#include "pool.h"
+#include "utils.h"      // NULL_CHECK()
+
+typedef struct {
+    void (*function)(void *);
+    void *arg;
+} Task;
+
+// Double-ended queue of tasks. Its owner pushes and pops at the bottom (newest task first),
+// while thieves take from the top (oldest task first), which tends to be the biggest piece of work
+typedef struct {
+    pthread_mutex_t lock;
+    Task *tasks;        // Circular buffer
+    size_t top;         // Position of the oldest task
+    size_t count;       // Number of queued tasks
+    size_t capacity;    // Always a power of 2
+} Deque;
+
+struct thread_pool {
+    int threads;
+    pthread_t *tids;
+    Deque *deques;              // One deque per worker
+    unsigned int nextDeque;     // Round-robin target for submissions from outside the pool
+
+    pthread_mutex_t lock;       // Protects the counters below
+    pthread_cond_t workReady;   // Signaled when a task is queued or the pool shuts down
+    pthread_cond_t allDone;     // Signaled when no tasks are pending
+    size_t queued;              // Tasks sitting in a deque, or about to be pushed to one
+    size_t pending;             // Tasks submitted but not finished yet
+    int shutdown;
+};
+
+// Arguments of a worker thread
+typedef struct {
+    ThreadPool *pool;
+    int id;
+} WorkerArgs;
+
+static _Thread_local int workerId = -1;
+
+static void deque_push(Deque *deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    // If the buffer is full, double its size and unwrap the tasks
+    if (deque->count == deque->capacity) {
+        Task *tasks = malloc(2 * deque->capacity * sizeof(*tasks));
+        NULL_CHECK(tasks, "malloc");
+        for (size_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->top + i) & (deque->capacity - 1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->top = 0;
+        deque->capacity *= 2;
+    }
+    deque->tasks[(deque->top + deque->count) & (deque->capacity - 1)] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Pop from the bottom (owner) or the top (thief). Returns false if the deque was empty
+static int deque_pop(Deque *deque, Task *task, int fromTop) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        if (fromTop) {
+            *task = deque->tasks[deque->top];
+            deque->top = (deque->top + 1) & (deque->capacity - 1);
+        }
+        else *task = deque->tasks[(deque->top + deque->count - 1) & (deque->capacity - 1)];
+        deque->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Take a task from the worker's own deque, or steal one from another worker
+static int find_task(ThreadPool *pool, int id, Task *task) {
+    if (deque_pop(&pool->deques[id], task, 0)) return 1;
+    for (int i = 1; i < pool->threads; i++) {
+        if (deque_pop(&pool->deques[(id + i) % pool->threads], task, 1)) return 1;
+    }
+    return 0;
+}
+
+static void *worker(void *arg) {
+    ThreadPool *pool = ((WorkerArgs *)arg)->pool;
+    workerId = ((WorkerArgs *)arg)->id;
+    free(arg);
+
+    Task task;
+    while (1) {
+        if (!find_task(pool, workerId, &task)) {
+            // Nothing to run or steal. Sleep until another task gets queued
+            pthread_mutex_lock(&pool->lock);
+            while (pool->queued == 0 && !pool->shutdown) pthread_cond_wait(&pool->workReady, &pool->lock);
+            int shutdown = pool->shutdown;
+            pthread_mutex_unlock(&pool->lock);
+            if (shutdown) return NULL;
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        task.function(task.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_broadcast(&pool->allDone);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool *pool_create(int threads) {
+    ThreadPool *pool = malloc(sizeof(*pool));
+    NULL_CHECK(pool, "malloc");
+    pool->threads = threads;
+    pool->nextDeque = 0;
+    pool->queued = 0;
+    pool->pending = 0;
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->allDone, NULL);
+
+    pool->deques = malloc(threads * sizeof(*pool->deques));
+    NULL_CHECK(pool->deques, "malloc");
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].top = 0;
+        pool->deques[i].count = 0;
+        pool->deques[i].capacity = 64;
+        pool->deques[i].tasks = malloc(pool->deques[i].capacity * sizeof(Task));
+        NULL_CHECK(pool->deques[i].tasks, "malloc");
+    }
+
+    pool->tids = malloc(threads * sizeof(*pool->tids));
+    NULL_CHECK(pool->tids, "malloc");
+    for (int i = 0; i < threads; i++) {
+        WorkerArgs *args = malloc(sizeof(*args));
+        NULL_CHECK(args, "malloc");
+        args->pool = pool;
+        args->id = i;
+        if (pthread_create(&pool->tids[i], NULL, worker, args) != 0) {
+            perror("pthread_create()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void pool_submit(ThreadPool *pool, void (*function)(void *), void *arg) {
+    Task task = { function, arg };
+
+    // The task is counted as queued before it is pushed, so that a worker that steals it right away
+    // never takes the counter below zero
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pool->queued++;
+    int target = (workerId != -1) ? workerId : (int)(pool->nextDeque++ % pool->threads);
+    pthread_mutex_unlock(&pool->lock);
+
+    deque_push(&pool->deques[target], task);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) pthread_cond_wait(&pool->allDone, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int pool_worker_id(void) {
+    return workerId;
+}
+
+void pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->threads; i++) {
+        if (pthread_join(pool->tids[i], NULL) != 0) {
+            perror("pthread_join()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    free(pool->tids);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->allDone);
+    free(pool);
+}
@@ -0,0 +1,425 @@
+#define _GNU_SOURCE                 // struct statx etc.
+
+#include <dirent.h>         // DIR etc.
+#include <errno.h>          // errno
+#include <fcntl.h>          // open() etc.
+#include <stdatomic.h>      // atomic_int etc.
+#include <stdint.h>         // uint64_t etc.
+#include <stdio.h>          // perror() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strcmp() etc.
+#include <sys/stat.h>       // struct statx etc.
+#include <sys/sysmacros.h>  // makedev()
+#include <sys/syscall.h>    // SYS_getdents64
+#include <unistd.h>         // syscall() etc.
+
+#include "info.h"           // GlobalInfo
+#include "scanner.h"
+#include "stats.h"          // stats_count()
+#include "uring.h"          // Uring
+#include "utils.h"          // NULL_CHECK() etc.
+
+// Size of the buffer that getdents64() fills with directory entries
+#define DENTS_BUFLEN (64 * 1024)
+// Number of submission entries of every io_uring instance
+#define URING_ENTRIES 256
+// Maximum number of subdirectories that are opened ahead of their scan
+#define MAX_OPEN_DIRS 256
+// Fields of statx() that EntryInfo uses
+#define STATX_FIELDS (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_MTIME)
+
+extern GlobalInfo *info;
+
+// One io_uring instance per worker of the pool, indexed by worker id. NULL if the
+// io_uring backend is not in use
+static Uring **rings = NULL;
+static int ringCount = 0;
+
+// Number of subdirectories that were opened ahead of their scan and are not closed yet
+static atomic_int openDirs = 0;
+
+// Layout of the records returned by getdents64()
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Name, inode and type of an entry, as listed by its directory
+typedef struct {
+    ino_t inode;
+    size_t nameOffset;      // Offset of the name in the names buffer of the directory
+    unsigned char type;     // DT_* type reported by the file system
+    int position;           // Position of the entry in the listing of the directory
+} Dent;
+
+// Creates a scan of given directory and schedules it on given pool
+static DirScan *scan_schedule(ThreadPool *pool, Arena **arenas, char *path, int fd, char fromHierarchy);
+
+// Returns the arena that the calling worker allocates the entries of given scan in
+static Arena *scan_arena(DirScan *scan) {
+    return scan->arenas[pool_worker_id()];
+}
+
+// Add an initialized entry to the scan of its directory. If the entry is a directory
+// that is already open, 'fd' is its descriptor. Otherwise it is -1
+static void scan_add(DirScan *scan, EntryInfo *entry, int fd) {
+    if (scan->count == scan->capacity) {
+        scan->capacity *= 2;
+        scan->entries = realloc(scan->entries, scan->capacity * sizeof(*scan->entries));
+        NULL_CHECK(scan->entries, "realloc");
+    }
+    scan->entries[scan->count++] = entry;
+
+    // Scan the subdirectory in parallel. Idle workers will steal it from this worker's deque
+    if (entry->fileType == DIRECTORY) {
+        if (scan->subdirCount == scan->subdirCapacity) {
+            scan->subdirCapacity *= 2;
+            scan->subdirs = realloc(scan->subdirs, scan->subdirCapacity * sizeof(*scan->subdirs));
+            NULL_CHECK(scan->subdirs, "realloc");
+        }
+        scan->subdirs[scan->subdirCount++] = scan_schedule(scan->pool, scan->arenas, entry->relativePath, fd, scan->fromHierarchy);
+    }
+}
+
+// Read a directory one entry at a time with readdir(), and stat the entries in the order they are listed
+static void scan_readdir(DirScan *scan, int dirFd) {
+    DIR *dir;
+    struct dirent *dirEntry;
+    if ((dir = fdopendir(dirFd)) == NULL) {
+        perror("fdopendir()");
+        exit(EXIT_FAILURE);
+    }
+
+    // For every entry of current directory
+    while ((dirEntry = readdir(dir)) != NULL) {
+        // Ignore parent and current folder
+        if (!strcmp(dirEntry->d_name, "..") || !strcmp(dirEntry->d_name, ".")) continue;
+
+        // NULL is only returned when faced with a symlink that points outside its hierarchy
+        EntryInfo *entry = entry_init(dirFd, scan->path, dirEntry->d_name, scan->fromHierarchy, scan_arena(scan));
+        if (entry != NULL) scan_add(scan, entry, -1);
+    }
+
+    if (closedir(dir) == -1) {
+        perror("closedir()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Sort directory entries by inode
+static int compare_inodes(const void *a, const void *b) {
+    ino_t inodeA = ((const Dent *)a)->inode, inodeB = ((const Dent *)b)->inode;
+    return (inodeA > inodeB) - (inodeA < inodeB);
+}
+
+int scanner_stats_directories(char fromHierarchy) {
+    // A manifest may later be merged, so it needs the metadata of every directory
+    char *saveManifest = (fromHierarchy == HIER_A) ? info->options.saveManifestA : info->options.saveManifestB;
+    return info->options.pathC != NULL || saveManifest != NULL;
+}
+
+// Returns true if the entry of a directory listing has to be stat'ed
+static int needs_stat(DirScan *scan, Dent *dent) {
+    return dent->type != DT_DIR || scanner_stats_directories(scan->fromHierarchy);
+}
+
+// Initialize a directory entry that was not stat'ed
+static EntryInfo *directory_init(DirScan *scan, char *name) {
+    struct stat myStat = { .st_mode = __S_IFDIR };
+    return entry_from_stat(&myStat, scan->path, name, scan->fromHierarchy, scan_arena(scan));
+}
+
+// Convert the result of statx() to a stat
+static void stat_from_statx(struct statx *stx, struct stat *myStat) {
+    memset(myStat, 0, sizeof(*myStat));
+    myStat->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    myStat->st_ino = stx->stx_ino;
+    myStat->st_mode = stx->stx_mode;
+    myStat->st_nlink = stx->stx_nlink;
+    myStat->st_size = stx->stx_size;
+    myStat->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    myStat->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+// Stat the entries of a directory through io_uring, with up to URING_ENTRIES requests in flight.
+// Requests are issued in the order of 'dents', and every entry is stored by its position in the listing
+static void stat_uring(DirScan *scan, Uring *ring, int dirFd, char *names, Dent *dents, int dentCount, EntryInfo **entries) {
+    struct statx *stats = malloc((dentCount + 1) * sizeof(*stats));
+    NULL_CHECK(stats, "malloc");
+
+    int next = 0, inFlight = 0;
+    while (next < dentCount || inFlight > 0) {
+        // Queue as many requests as the submission queue fits
+        struct io_uring_sqe *sqe;
+        while (next < dentCount) {
+            char *name = names + dents[next].nameOffset;
+            if (!needs_stat(scan, &dents[next])) {
+                entries[dents[next].position] = directory_init(scan, name);
+                next++;
+                continue;
+            }
+            if ((sqe = uring_get_sqe(ring)) == NULL) break;
+            stats_count(COUNT_LSTAT, 1);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = (unsigned long)name;
+            sqe->len = STATX_FIELDS;
+            sqe->off = (unsigned long)&stats[next];
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = next;
+            next++;
+            inFlight++;
+        }
+        if (inFlight == 0) break;
+
+        // Wait for at least one result, then collect every result that is ready
+        uring_submit(ring, 1);
+        struct io_uring_cqe cqe;
+        while (uring_get_cqe(ring, &cqe, 0)) {
+            inFlight--;
+            int i = (int)cqe.user_data;
+            if (cqe.res < 0) {
+                errno = -cqe.res;
+                perror("statx()");
+                exit(EXIT_FAILURE);
+            }
+            struct stat myStat;
+            stat_from_statx(&stats[i], &myStat);
+            entries[dents[i].position] = entry_from_stat(&myStat, scan->path, names + dents[i].nameOffset, scan->fromHierarchy, scan_arena(scan));
+        }
+    }
+    free(stats);
+}
+
+// Open the subdirectories of a directory through io_uring, so that their scans don't have to resolve
+// their paths. At most MAX_OPEN_DIRS directories are kept open ahead of their scans. The descriptors
+// are stored in 'fds' by the position of their entries. Directories that were not opened get -1
+static void open_uring(Uring *ring, int dirFd, EntryInfo **entries, int count, int *fds) {
+    int next = 0, inFlight = 0;
+    while (next < count || inFlight > 0) {
+        struct io_uring_sqe *sqe;
+        while (next < count) {
+            if (entries[next] == NULL || entries[next]->fileType != DIRECTORY) {
+                next++;
+                continue;
+            }
+            // Past the limit, the scan of the subdirectory opens it by itself
+            if (atomic_fetch_add(&openDirs, 1) >= MAX_OPEN_DIRS) {
+                atomic_fetch_sub(&openDirs, 1);
+                next++;
+                continue;
+            }
+            if ((sqe = uring_get_sqe(ring)) == NULL) {
+                atomic_fetch_sub(&openDirs, 1);
+                break;
+            }
+            stats_count(COUNT_OPEN, 1);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = dirFd;
+            sqe->addr = (unsigned long)entries[next]->name;
+            sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+            sqe->user_data = next;
+            next++;
+            inFlight++;
+        }
+        if (inFlight == 0) break;
+
+        uring_submit(ring, 1);
+        struct io_uring_cqe cqe;
+        while (uring_get_cqe(ring, &cqe, 0)) {
+            inFlight--;
+            // If the open failed (e.g. too many open files), the scan of the subdirectory retries it
+            if (cqe.res < 0) atomic_fetch_sub(&openDirs, 1);
+            else fds[cqe.user_data] = cqe.res;
+        }
+    }
+}
+
+// Read a whole directory in large getdents64() batches, then stat its entries in inode order
+static void scan_getdents(DirScan *scan, int dirFd) {
+    char *buffer = malloc(DENTS_BUFLEN);
+    NULL_CHECK(buffer, "malloc");
+
+    // Dynamic buffers with the listing of the directory and the names of its entries
+    int dentCapacity = 64, dentCount = 0;
+    Dent *dents = malloc(dentCapacity * sizeof(*dents));
+    NULL_CHECK(dents, "malloc");
+    size_t namesCapacity = 1024, namesLen = 0;
+    char *names = malloc(namesCapacity);
+    NULL_CHECK(names, "malloc");
+    int unknownTypes = 0;
+
+    long n;
+    while ((n = syscall(SYS_getdents64, dirFd, buffer, DENTS_BUFLEN)) > 0) {
+        for (long offset = 0; offset < n; ) {
+            struct linux_dirent64 *dirEntry = (struct linux_dirent64 *)(buffer + offset);
+            offset += dirEntry->d_reclen;
+
+            // Ignore parent and current folder
+            if (!strcmp(dirEntry->d_name, "..") || !strcmp(dirEntry->d_name, ".")) continue;
+
+            size_t nameLen = strlen(dirEntry->d_name) + 1;
+            if (namesLen + nameLen > namesCapacity) {
+                do { namesCapacity *= 2; } while (namesLen + nameLen > namesCapacity);
+                names = realloc(names, namesCapacity);
+                NULL_CHECK(names, "realloc");
+            }
+            memcpy(names + namesLen, dirEntry->d_name, nameLen);
+
+            if (dentCount == dentCapacity) {
+                dentCapacity *= 2;
+                dents = realloc(dents, dentCapacity * sizeof(*dents));
+                NULL_CHECK(dents, "realloc");
+            }
+            dents[dentCount].inode = dirEntry->d_ino;
+            dents[dentCount].nameOffset = namesLen;
+            dents[dentCount].type = dirEntry->d_type;
+            dents[dentCount].position = dentCount;
+            dentCount++;
+            namesLen += nameLen;
+
+            if (dirEntry->d_type == DT_UNKNOWN) unknownTypes = 1;
+        }
+    }
+    if (n == -1) {
+        perror("getdents64()");
+        exit(EXIT_FAILURE);
+    }
+    free(buffer);
+
+    // Case: The file system does not report types. Stat every entry in the order it was listed
+    if (unknownTypes) {
+        for (int i = 0; i < dentCount; i++) {
+            EntryInfo *entry = entry_init(dirFd, scan->path, names + dents[i].nameOffset, scan->fromHierarchy, scan_arena(scan));
+            if (entry != NULL) scan_add(scan, entry, -1);
+        }
+    }
+    // Case: Types are known. Stat the entries in inode order, which is close to their order on disk,
+    // but keep the order of the listing for the entries themselves
+    else {
+        EntryInfo **entries = calloc(dentCount + 1, sizeof(*entries));
+        NULL_CHECK(entries, "calloc");
+        int *fds = malloc((dentCount + 1) * sizeof(*fds));
+        NULL_CHECK(fds, "malloc");
+        for (int i = 0; i < dentCount; i++) fds[i] = -1;
+
+        qsort(dents, dentCount, sizeof(*dents), compare_inodes);
+        Uring *ring = (rings != NULL) ? rings[pool_worker_id()] : NULL;
+        if (ring != NULL) {
+            stat_uring(scan, ring, dirFd, names, dents, dentCount, entries);
+            open_uring(ring, dirFd, entries, dentCount, fds);
+        }
+        else {
+            for (int i = 0; i < dentCount; i++) {
+                char *name = names + dents[i].nameOffset;
+                if (!needs_stat(scan, &dents[i])) entries[dents[i].position] = directory_init(scan, name);
+                else entries[dents[i].position] = entry_init(dirFd, scan->path, name, scan->fromHierarchy, scan_arena(scan));
+            }
+        }
+        // NULL is only returned when faced with a symlink that points outside its hierarchy
+        for (int i = 0; i < dentCount; i++) {
+            if (entries[i] != NULL) scan_add(scan, entries[i], fds[i]);
+        }
+        free(entries);
+        free(fds);
+    }
+
+    free(dents);
+    free(names);
+    if (close(dirFd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Task that reads a directory and schedules the scan of every subdirectory found in it
+static void scan_task(void *arg) {
+    DirScan *scan = arg;
+
+    // The path is resolved once per directory, unless the directory was already opened by the scan
+    // of its parent. Its entries are then looked up through the directory's file descriptor
+    int dirFd = scan->fd;
+    if (dirFd == -1) stats_count(COUNT_OPEN, 1);
+    if (dirFd == -1 && (dirFd = open(scan->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+
+    if (info->options.scanBackend == SCAN_READDIR) scan_readdir(scan, dirFd);
+    else scan_getdents(scan, dirFd);
+
+    if (scan->fd != -1) atomic_fetch_sub(&openDirs, 1);
+}
+
+static DirScan *scan_schedule(ThreadPool *pool, Arena **arenas, char *path, int fd, char fromHierarchy) {
+    DirScan *scan = malloc(sizeof(*scan));
+    NULL_CHECK(scan, "malloc");
+    scan->path = path;
+    scan->fd = fd;
+    scan->fromHierarchy = fromHierarchy;
+    scan->pool = pool;
+    scan->arenas = arenas;
+
+    scan->count = 0;
+    scan->capacity = 8;
+    scan->entries = malloc(scan->capacity * sizeof(*scan->entries));
+    NULL_CHECK(scan->entries, "malloc");
+
+    scan->subdirCount = 0;
+    scan->subdirCapacity = 4;
+    scan->subdirs = malloc(scan->subdirCapacity * sizeof(*scan->subdirs));
+    NULL_CHECK(scan->subdirs, "malloc");
+
+    pool_submit(pool, scan_task, scan);
+    return scan;
+}
+
+// Opcodes of the requests that stat entries and open subdirectories
+static const unsigned char opcodes[] = {IORING_OP_STATX, IORING_OP_OPENAT};
+
+void scanner_init(int workers) {
+    if (info->options.scanBackend != SCAN_URING) return;
+
+    rings = malloc(workers * sizeof(*rings));
+    NULL_CHECK(rings, "malloc");
+    for (ringCount = 0; ringCount < workers; ringCount++) {
+        if ((rings[ringCount] = uring_create(URING_ENTRIES)) != NULL) {
+            // Kernels before 5.6 have io_uring, but neither statx() nor openat() through it
+            if (ringCount > 0 || uring_supports(rings[0], opcodes, sizeof(opcodes))) continue;
+            fprintf(stderr, "io_uring lacks the requests that scan directories\n");
+            ringCount++;
+        }
+        else perror("io_uring_setup()");
+
+        // Fall back to the synchronous backend if io_uring can't be used
+        fprintf(stderr, "io_uring is not available, falling back to --scan=getdents\n");
+        scanner_destroy();
+        return;
+    }
+}
+
+void scanner_destroy(void) {
+    if (rings == NULL) return;
+    for (int i = 0; i < ringCount; i++) {
+        uring_destroy(rings[i]);
+    }
+    free(rings);
+    rings = NULL;
+    ringCount = 0;
+}
+
+DirScan *scan_directory(ThreadPool *pool, Arena **arenas, char *path, char fromHierarchy) {
+    return scan_schedule(pool, arenas, path, -1, fromHierarchy);
+}
+
+void scan_destroy(DirScan *scan) {
+    for (int i = 0; i < scan->subdirCount; i++) {
+        scan_destroy(scan->subdirs[i]);
+    }
+    free(scan->entries);
+    free(scan->subdirs);
+    free(scan);
+}
@@ -0,0 +1,285 @@
+#include <errno.h>          // errno
+#include <fcntl.h>          // open() etc.
+#include <pthread.h>        // pthread_mutex_t etc.
+#include <stdint.h>         // uint64_t etc.
+#include <stdio.h>          // perror() etc.
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // memcmp() etc.
+#include <sys/file.h>       // flock()
+#include <sys/mman.h>       // mmap() etc.
+#include <sys/stat.h>       // fstat()
+#include <time.h>           // time()
+#include <unistd.h>         // close() etc.
+
+#include "sigcache.h"
+#include "stats.h"          // stats_count()
+#include "utils.h"          // NULL_CHECK() etc.
+
+// Identifies a cache file, along with the version of its layout
+#define CACHE_MAGIC "cmpcat\0\1"
+// Number of records that are buffered before they are written to the file
+#define WRITE_RECORDS 256
+
+// Start of the cache file. The records follow, sorted on (device, inode)
+typedef struct {
+    char magic[8];
+    uint64_t count;         // Number of records
+} Header;
+
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime;
+    int64_t mtimeNsec;
+    unsigned char digest[SHA256_LEN];
+} Record;
+
+struct sig_cache {
+    char *path;             // Path of the cache file
+    Header *map;            // Mapping of the cache file. NULL if there was no valid file
+    size_t mapLen;
+    Record *records;        // Records of the mapped file
+    size_t count;
+    Record *added;          // Records of the files hashed during this run, in no particular order
+    size_t addedCount;
+    size_t addedCapacity;
+    time_t opened;          // Time the cache was opened
+    pthread_mutex_t lock;   // Guards the added records
+};
+
+// Map the cache file found in 'path'. Returns its header, or NULL if there is no valid cache file
+static Header *cache_map(char *path, size_t *mapLen) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT) return NULL;
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    struct stat myStat;
+    if (fstat(fd, &myStat) == -1) {
+        perror("fstat()");
+        exit(EXIT_FAILURE);
+    }
+
+    Header *header = NULL;
+    *mapLen = myStat.st_size;
+    if (*mapLen >= sizeof(Header)) {
+        header = mmap(NULL, *mapLen, PROT_READ, MAP_SHARED, fd, 0);
+        if (header == MAP_FAILED) {
+            perror("mmap()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+
+    // A file that is not a whole cache is ignored, and gets replaced when the cache is written back
+    if (header == NULL || memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+        *mapLen != sizeof(Header) + header->count * sizeof(Record)) {
+        fprintf(stderr, "Ignoring invalid cache file %s\n", path);
+        if (header != NULL && munmap(header, *mapLen) == -1) {
+            perror("munmap()");
+            exit(EXIT_FAILURE);
+        }
+        return NULL;
+    }
+    return header;
+}
+
+static void cache_unmap(Header *header, size_t mapLen) {
+    if (header != NULL && munmap(header, mapLen) == -1) {
+        perror("munmap()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Order records on their (device, inode)
+static int record_compare(const void *a, const void *b) {
+    const Record *recordA = a, *recordB = b;
+    if (recordA->device != recordB->device) return (recordA->device < recordB->device) ? -1 : 1;
+    if (recordA->inode != recordB->inode) return (recordA->inode < recordB->inode) ? -1 : 1;
+    return 0;
+}
+
+SigCache *cache_open(char *path) {
+    SigCache *cache = malloc(sizeof(*cache));
+    NULL_CHECK(cache, "malloc");
+    cache->path = duplicate_string(path);
+    cache->map = cache_map(path, &cache->mapLen);
+    cache->records = (cache->map != NULL) ? (Record *)(cache->map + 1) : NULL;
+    cache->count = (cache->map != NULL) ? cache->map->count : 0;
+    cache->added = NULL;
+    cache->addedCount = 0;
+    cache->addedCapacity = 0;
+    cache->opened = time(NULL);
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+// Read the whole file 'fd' from its start and store the SHA-256 of its contents in 'digest'
+static void file_digest(int fd, unsigned char digest[SHA256_LEN]) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Sha256 sha;
+    sha256_init(&sha);
+    char buffer[16 * BUFLEN];
+    ssize_t n;
+    off_t offset = 0;
+    while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        sha256_update(&sha, buffer, n);
+        offset += n;
+    }
+    stats_count(COUNT_READ, offset);
+    if (n == -1) {
+        perror("pread()");
+        exit(EXIT_FAILURE);
+    }
+    sha256_final(&sha, digest);
+}
+
+// Key of the record of given entry
+static void record_key(EntryInfo *entry, Record *key) {
+    key->device = entry->device;
+    key->inode = entry->inode;
+    key->size = entry->size;
+    key->mtime = entry->mtime;
+    key->mtimeNsec = entry->mtimeNsec;
+}
+
+int cache_lookup(SigCache *cache, EntryInfo *entry, unsigned char digest[SHA256_LEN]) {
+    Record key;
+    record_key(entry, &key);
+    // A record is only valid if the file has the same size and modification time as when it was hashed
+    Record *record = (cache->count > 0) ? bsearch(&key, cache->records, cache->count, sizeof(Record), record_compare) : NULL;
+    if (record == NULL || record->size != key.size || record->mtime != key.mtime || record->mtimeNsec != key.mtimeNsec) return 0;
+    memcpy(digest, record->digest, SHA256_LEN);
+    return 1;
+}
+
+void cache_digest(SigCache *cache, EntryInfo *entry, int fd, unsigned char digest[SHA256_LEN]) {
+    Record key;
+    record_key(entry, &key);
+    file_digest(fd, key.digest);
+    memcpy(digest, key.digest, SHA256_LEN);
+
+    // A file modified in the last second could still change without its modification time
+    // changing (on filesystems with coarse timestamps), so its signature is not stored
+    if (key.mtime >= cache->opened - 1) return;
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->addedCount == cache->addedCapacity) {
+        cache->addedCapacity = (cache->addedCapacity == 0) ? 64 : 2 * cache->addedCapacity;
+        cache->added = realloc(cache->added, cache->addedCapacity * sizeof(*cache->added));
+        NULL_CHECK(cache->added, "realloc");
+    }
+    cache->added[cache->addedCount++] = key;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Append a record to the buffer of records. The buffer is written to 'fd' once full
+static void record_write(int fd, Record *buffer, int *buffered, Record *record) {
+    buffer[(*buffered)++] = *record;
+    if (*buffered == WRITE_RECORDS) {
+        fullwrite(fd, buffer, *buffered * sizeof(*buffer));
+        *buffered = 0;
+    }
+}
+
+// Write the records of the cache file merged with the added ones to a new file that replaces it
+static void cache_write(SigCache *cache) {
+    size_t len = strlen(cache->path);
+    char *lockPath = malloc(len + sizeof(".lock"));
+    NULL_CHECK(lockPath, "malloc");
+    sprintf(lockPath, "%s.lock", cache->path);
+    char *tempPath = malloc(len + sizeof(".tmp"));
+    NULL_CHECK(tempPath, "malloc");
+    sprintf(tempPath, "%s.tmp", cache->path);
+
+    // Only one run at a time writes the cache
+    int lockFd = open(lockPath, O_RDWR | O_CREAT, 0644);
+    if (lockFd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    if (flock(lockFd, LOCK_EX) == -1) {
+        perror("flock()");
+        exit(EXIT_FAILURE);
+    }
+
+    // Another run may have replaced the file since it was opened, so merge with its latest contents
+    size_t mapLen;
+    Header *latest = cache_map(cache->path, &mapLen);
+    Record *records = (latest != NULL) ? (Record *)(latest + 1) : NULL;
+    size_t count = (latest != NULL) ? latest->count : 0;
+    qsort(cache->added, cache->addedCount, sizeof(Record), record_compare);
+
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    // The header is written last, once the number of records is known
+    Header header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.count = 0;
+    fullwrite(fd, &header, sizeof(header));
+
+    Record buffer[WRITE_RECORDS];
+    int buffered = 0;
+    size_t i = 0, j = 0;
+    while (i < count || j < cache->addedCount) {
+        // A file hashed more than once in this run keeps its last record
+        if (j + 1 < cache->addedCount && !record_compare(&cache->added[j], &cache->added[j+1])) {
+            j++;
+            continue;
+        }
+        int order = (i == count) ? 1 : (j == cache->addedCount) ? -1 : record_compare(&records[i], &cache->added[j]);
+        if (order < 0) record_write(fd, buffer, &buffered, &records[i++]);
+        else {
+            // An added record replaces the stored record of the same file
+            if (order == 0) i++;
+            record_write(fd, buffer, &buffered, &cache->added[j++]);
+        }
+        header.count++;
+    }
+    fullwrite(fd, buffer, buffered * sizeof(*buffer));
+
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        perror("pwrite()");
+        exit(EXIT_FAILURE);
+    }
+    // Make sure the contents of the new file reach the disk before it replaces the old one
+    if (fsync(fd) == -1) {
+        perror("fsync()");
+        exit(EXIT_FAILURE);
+    }
+    if (close(fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    if (rename(tempPath, cache->path) == -1) {
+        perror("rename()");
+        exit(EXIT_FAILURE);
+    }
+
+    cache_unmap(latest, mapLen);
+    // Closing the lock file releases the lock
+    if (close(lockFd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    free(lockPath);
+    free(tempPath);
+}
+
+void cache_close(SigCache *cache) {
+    if (cache->addedCount > 0) cache_write(cache);
+    cache_unmap(cache->map, cache->mapLen);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->added);
+    free(cache->path);
+    free(cache);
+}
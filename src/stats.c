@@ -0,0 +1,170 @@
+#include <pthread.h>        // pthread_key_t etc.
+#include <stdatomic.h>      // atomic_ulong etc.
+#include <stdio.h>          // fprintf() etc.
+#include <stdlib.h>         // aligned_alloc() etc.
+#include <string.h>         // memset()
+#include <sys/resource.h>   // getrusage()
+#include <time.h>           // clock_gettime()
+
+#include "copy.h"           // copy_report()
+#include "policy.h"         // policy_report()
+#include "stats.h"
+#include "utils.h"          // NULL_CHECK()
+
+// Names of the phases and of the counters, as reported
+static const char *phaseNames[PHASE_COUNT] = {"setup", "scan", "compare", "print", "plan", "merge", "walk", "watch", "cleanup"};
+static const char *counterNames[COUNT_COUNT] = {"entriesA", "entriesB", "pairs", "avoidedCompares", "bytesRead",
+                                                "bytesWritten", "linked", "lstat", "realpath", "open"};
+
+// Counters of a single thread. Aligned to a cache line, so that threads never write to the same one
+typedef struct Counters {
+    _Alignas(64) atomic_ulong values[COUNT_COUNT];
+    struct Counters *prev;
+    struct Counters *next;
+} Counters;
+
+// Counters of the calling thread. NULL until it counts something
+static _Thread_local Counters *counters = NULL;
+// Counters of every thread that is still running, and the totals of the threads that exited
+static Counters *running = NULL;
+static unsigned long exited[COUNT_COUNT];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Protects the list and the totals above
+// Key whose destructor adds the counters of an exiting thread to the totals
+static pthread_key_t key;
+
+// Time spent in every phase, and whether it was ever entered
+static int phase = PHASE_SETUP;
+static struct timespec wallStart, cpuStart;
+static double wallTimes[PHASE_COUNT], cpuTimes[PHASE_COUNT];
+static int entered[PHASE_COUNT];
+
+// Add the counters of a thread that exits to the totals, and free them
+static void counters_retire(void *arg) {
+    Counters *mine = arg;
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < COUNT_COUNT; i++) exited[i] += atomic_load_explicit(&mine->values[i], memory_order_relaxed);
+    if (mine->prev != NULL) mine->prev->next = mine->next;
+    else running = mine->next;
+    if (mine->next != NULL) mine->next->prev = mine->prev;
+    pthread_mutex_unlock(&lock);
+    free(mine);
+}
+
+// Create the counters of the calling thread
+static void counters_register(void) {
+    counters = aligned_alloc(_Alignof(Counters), sizeof(Counters));
+    NULL_CHECK(counters, "aligned_alloc");
+    memset(counters, 0, sizeof(*counters));
+    pthread_mutex_lock(&lock);
+    counters->next = running;
+    if (running != NULL) running->prev = counters;
+    running = counters;
+    pthread_mutex_unlock(&lock);
+    if (pthread_setspecific(key, counters) != 0) {
+        perror("pthread_setspecific()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Returns the seconds passed on given clock since '*since', and moves '*since' to now
+static double lap(clockid_t clock, struct timespec *since) {
+    struct timespec now;
+    if (clock_gettime(clock, &now) == -1) {
+        perror("clock_gettime()");
+        exit(EXIT_FAILURE);
+    }
+    double seconds = (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+    *since = now;
+    return seconds;
+}
+
+void stats_init(void) {
+    if (pthread_key_create(&key, counters_retire) != 0) {
+        perror("pthread_key_create()");
+        exit(EXIT_FAILURE);
+    }
+    lap(CLOCK_MONOTONIC, &wallStart);
+    // The CPU time of the process counts every thread, including the ones that work while the main thread waits
+    lap(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+    entered[PHASE_SETUP] = 1;
+}
+
+void stats_phase(int next) {
+    wallTimes[phase] += lap(CLOCK_MONOTONIC, &wallStart);
+    cpuTimes[phase] += lap(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+    phase = next;
+    entered[phase] = 1;
+}
+
+void stats_count(int counter, unsigned long n) {
+    if (counters == NULL) counters_register();
+    // Only this thread writes to its counters, so they need no atomic read-modify-write. They are
+    // atomic only so that the report may read them while the thread runs
+    atomic_ulong *value = &counters->values[counter];
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void stats_report(FILE *stream, char format, int merged) {
+    stats_phase(phase);
+
+    unsigned long totals[COUNT_COUNT];
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < COUNT_COUNT; i++) {
+        totals[i] = exited[i];
+        for (Counters *thread = running; thread != NULL; thread = thread->next) {
+            totals[i] += atomic_load_explicit(&thread->values[i], memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    // The peak resident memory is given in KiB
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        perror("getrusage()");
+        exit(EXIT_FAILURE);
+    }
+
+    if (format == STATS_JSON) {
+        fprintf(stream, "{\"phases\":{");
+        const char *separator = "";
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            if (!entered[i]) continue;
+            fprintf(stream, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", separator, phaseNames[i], wallTimes[i], cpuTimes[i]);
+            separator = ",";
+        }
+        fprintf(stream, "},\"counters\":{");
+        for (int i = 0; i < COUNT_COUNT; i++) {
+            fprintf(stream, "%s\"%s\":%lu", (i > 0) ? "," : "", counterNames[i], totals[i]);
+        }
+        fprintf(stream, "},\"peakRss\":%lld,\"tiers\":", (long long)usage.ru_maxrss * 1024);
+        policy_report(stream, 1);
+        if (merged) {
+            fprintf(stream, ",\"copies\":");
+            copy_report(stream, 1);
+        }
+        fprintf(stream, "}\n");
+        return;
+    }
+
+    fprintf(stream, "Phases:\n");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (entered[i]) fprintf(stream, "\t%-8s %12.3f s wall %12.3f s cpu\n", phaseNames[i], wallTimes[i], cpuTimes[i]);
+    }
+    fprintf(stream, "Counters:\n");
+    for (int i = 0; i < COUNT_COUNT; i++) fprintf(stream, "\t%-16s %16lu\n", counterNames[i], totals[i]);
+    fprintf(stream, "\t%-16s %16ld KiB\n", "peakRss", usage.ru_maxrss);
+    policy_report(stream, 0);
+    if (merged) copy_report(stream, 0);
+}
+
+void stats_destroy(void) {
+    pthread_mutex_lock(&lock);
+    while (running != NULL) {
+        Counters *next = running->next;
+        free(running);
+        running = next;
+    }
+    pthread_mutex_unlock(&lock);
+    counters = NULL;
+    pthread_key_delete(key);
+}
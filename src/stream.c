@@ -0,0 +1,178 @@
+#include <dirent.h>         // DIR etc.
+#include <fcntl.h>          // open() etc.
+#include <stdio.h>          // perror()
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strcmp() etc.
+
+#include "arena.h"          // Arena
+#include "cat_manager.h"    // SAME
+#include "info.h"           // GlobalInfo
+#include "merger.h"         // Merger
+#include "output.h"         // output_difference() etc.
+#include "policy.h"         // policy_entries_verdict()
+#include "stats.h"          // stats_count()
+#include "stream.h"
+#include "utils.h"          // NULL_CHECK()
+
+// Size of the chunks that the entries of a single directory are allocated in
+#define LISTING_CHUNK (64 * 1024)
+
+extern GlobalInfo *info;
+
+// Entries of a single directory, sorted by name
+typedef struct {
+    Arena *arena;           // Holds the entries, along with their paths
+    EntryInfo **entries;
+    int count;
+} Listing;
+
+// Pair of same-name entries, either of which may be missing, whose subdirectories are walked
+typedef struct {
+    EntryInfo *entryA;
+    EntryInfo *entryB;
+} Descent;
+
+// Executor that creates the merged entries. NULL if the user only wants to compare
+static Merger *merger = NULL;
+
+// Order entries by name
+static int compare_names(const void *a, const void *b) {
+    return strcmp((*(EntryInfo * const *)a)->name, (*(EntryInfo * const *)b)->name);
+}
+
+// Read and sort the entries of the directory found in 'path'
+static void listing_read(Listing *listing, char *path, char fromHierarchy) {
+    listing->arena = arena_create(LISTING_CHUNK);
+    listing->count = 0;
+    int capacity = 16;
+    listing->entries = malloc(capacity * sizeof(*listing->entries));
+    NULL_CHECK(listing->entries, "malloc");
+
+    stats_count(COUNT_OPEN, 1);
+    int dirFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    DIR *dir = fdopendir(dirFd);
+    if (dir == NULL) {
+        perror("fdopendir()");
+        exit(EXIT_FAILURE);
+    }
+    struct dirent *dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        // Ignore parent and current folder
+        if (!strcmp(dirEntry->d_name, "..") || !strcmp(dirEntry->d_name, ".")) continue;
+
+        // NULL is only returned when faced with a symlink that points outside its hierarchy
+        EntryInfo *entry = entry_init(dirFd, path, dirEntry->d_name, fromHierarchy, listing->arena);
+        if (entry == NULL) continue;
+        if (listing->count == capacity) {
+            capacity *= 2;
+            listing->entries = realloc(listing->entries, capacity * sizeof(*listing->entries));
+            NULL_CHECK(listing->entries, "realloc");
+        }
+        listing->entries[listing->count++] = entry;
+    }
+    if (closedir(dir) == -1) {
+        perror("closedir()");
+        exit(EXIT_FAILURE);
+    }
+    qsort(listing->entries, listing->count, sizeof(*listing->entries), compare_names);
+}
+
+// Destroy a listing, once the merge no longer refers to its entries
+static void listing_destroy(Listing *listing) {
+    if (merger != NULL) merger_wait(merger);
+    arena_destroy(listing->arena);
+    free(listing->entries);
+}
+
+// Print an entry that has no same entry in the other hierarchy. 'partner' is its same-name entry, or NULL
+static void report(EntryInfo *entry, EntryInfo *partner, char verdict) {
+    output_difference(entry, partner, verdict);
+}
+
+// Create an entry in hierarchyC, if the user wants to merge
+static void merge(EntryInfo *entry) {
+    if (merger != NULL) merger_add(merger, entry);
+}
+
+// Print and merge every entry below a directory that only one hierarchy has
+static void walk_unique(char *path, char fromHierarchy) {
+    Listing listing;
+    listing_read(&listing, path, fromHierarchy);
+    for (int i = 0; i < listing.count; i++) {
+        report(listing.entries[i], NULL, MISSING);
+        merge(listing.entries[i]);
+    }
+    output_flush();
+    // Every directory is created before its children
+    if (merger != NULL) merger_barrier(merger);
+
+    for (int i = 0; i < listing.count; i++) {
+        if (listing.entries[i]->fileType == DIRECTORY) walk_unique(listing.entries[i]->relativePath, fromHierarchy);
+    }
+    listing_destroy(&listing);
+}
+
+// Print and merge the differences of a pair of same-name directories, then walk their subdirectories
+static void walk_pair(char *pathA, char *pathB) {
+    Listing listingA, listingB;
+    listing_read(&listingA, pathA, HIER_A);
+    listing_read(&listingB, pathB, HIER_B);
+    Descent *descents = malloc((listingA.count + listingB.count + 1) * sizeof(*descents));
+    NULL_CHECK(descents, "malloc");
+    int descentCount = 0;
+
+    // Both listings are sorted, so same-name entries are found by merging them
+    int i = 0, j = 0;
+    while (i < listingA.count || j < listingB.count) {
+        int order = (i == listingA.count) ? 1 : (j == listingB.count) ? -1 : strcmp(listingA.entries[i]->name, listingB.entries[j]->name);
+        EntryInfo *entryA = (order <= 0) ? listingA.entries[i++] : NULL;
+        EntryInfo *entryB = (order >= 0) ? listingB.entries[j++] : NULL;
+
+        if (entryA == NULL || entryB == NULL) {
+            // A unique entry gets merged
+            EntryInfo *entry = (entryA != NULL) ? entryA : entryB;
+            report(entry, NULL, MISSING);
+            merge(entry);
+        }
+        else {
+            char verdict = policy_entries_verdict(entryA, entryB);
+            if (verdict != SAME) {
+                report(entryA, entryB, verdict);
+                report(entryB, entryA, verdict);
+            }
+            // If 2 entries have the same name, keep the newest one. If A and B
+            // have the same modified time, keep B
+            merge((entryA->mtime <= entryB->mtime) ? entryB : entryA);
+        }
+
+        // Only directories have children. The children of a directory whose partner is not a directory are unique
+        if (entryA != NULL && entryA->fileType != DIRECTORY) entryA = NULL;
+        if (entryB != NULL && entryB->fileType != DIRECTORY) entryB = NULL;
+        if (entryA != NULL || entryB != NULL) descents[descentCount++] = (Descent){entryA, entryB};
+    }
+    // The differences of this pair are complete
+    output_flush();
+    if (merger != NULL) merger_barrier(merger);
+
+    for (int k = 0; k < descentCount; k++) {
+        if (descents[k].entryA != NULL && descents[k].entryB != NULL) walk_pair(descents[k].entryA->relativePath, descents[k].entryB->relativePath);
+        else if (descents[k].entryA != NULL) walk_unique(descents[k].entryA->relativePath, HIER_A);
+        else walk_unique(descents[k].entryB->relativePath, HIER_B);
+    }
+    free(descents);
+    listing_destroy(&listingA);
+    listing_destroy(&listingB);
+}
+
+void stream_walk(void) {
+    if (info->options.pathC != NULL) merger = merger_create();
+    walk_pair(info->relativeA, info->relativeB);
+    if (merger != NULL) {
+        merger_destroy(merger);
+        merger = NULL;
+    }
+}
@@ -0,0 +1,208 @@
+#include <errno.h>          // errno
+#include <fcntl.h>          // AT_FDCWD etc.
+#include <stdio.h>          // perror()
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // memset()
+#include <sys/mman.h>       // mmap() etc.
+#include <sys/syscall.h>    // SYS_io_uring_setup etc.
+#include <unistd.h>         // syscall() etc.
+
+#include "uring.h"
+#include "utils.h"          // NULL_CHECK()
+
+// The rings are shared with the kernel. Indices written by one side are published with
+// release stores and read by the other side with acquire loads
+struct uring {
+    int fd;
+    unsigned int entries;
+
+    // Submission queue
+    void *sqRing;
+    size_t sqRingSize;
+    unsigned int *sqHead;
+    unsigned int *sqTail;
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned int sqeTail;       // Tail of the prepared entries, not yet published to the kernel
+    unsigned int sqePublished;  // Tail that was last published to the kernel
+
+    // Completion queue
+    void *cqRing;
+    size_t cqRingSize;
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    struct io_uring_cqe *cqes;
+};
+
+Uring *uring_create(unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(SYS_io_uring_setup, entries, &params);
+    if (fd == -1) return NULL;
+
+    Uring *ring = malloc(sizeof(*ring));
+    NULL_CHECK(ring, "malloc");
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqeTail = 0;
+    ring->sqePublished = 0;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Newer kernels map both rings with a single mmap()
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        perror("mmap()");
+        exit(EXIT_FAILURE);
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) ring->cqRing = ring->sqRing;
+    else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            perror("mmap()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        perror("mmap()");
+        exit(EXIT_FAILURE);
+    }
+
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqHead = (unsigned int *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned int *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned int *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+struct io_uring_sqe *uring_get_sqe(Uring *ring) {
+    unsigned int head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (ring->sqeTail - head >= ring->entries) return NULL;
+
+    unsigned int index = ring->sqeTail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqeTail++;
+    return sqe;
+}
+
+void uring_submit(Uring *ring, unsigned int waitNr) {
+    unsigned int toSubmit = ring->sqeTail - ring->sqePublished;
+    __atomic_store_n(ring->sqTail, ring->sqeTail, __ATOMIC_RELEASE);
+    ring->sqePublished = ring->sqeTail;
+    if (toSubmit == 0 && waitNr == 0) return;
+
+    unsigned int flags = (waitNr > 0) ? IORING_ENTER_GETEVENTS : 0;
+    while (syscall(SYS_io_uring_enter, ring->fd, toSubmit, waitNr, flags, NULL, 0) == -1) {
+        if (errno == EINTR) {
+            // The entries were already consumed. Only keep waiting
+            toSubmit = 0;
+            continue;
+        }
+        perror("io_uring_enter()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int uring_get_cqe(Uring *ring, struct io_uring_cqe *cqe, int wait) {
+    unsigned int head = *ring->cqHead;
+    while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        if (!wait) return 0;
+        uring_submit(ring, 1);
+    }
+    *cqe = ring->cqes[head & *ring->cqMask];
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+unsigned int uring_sq_space(Uring *ring) {
+    unsigned int head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    return ring->entries - (ring->sqeTail - head);
+}
+
+int uring_supports(Uring *ring, const unsigned char *opcodes, int count) {
+    // The kernel fills an entry per opcode it knows, up to the last one it knows
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    NULL_CHECK(probe, "calloc");
+    int supported = (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) != -1);
+    for (int i = 0; supported && i < count; i++) {
+        supported = (opcodes[i] <= probe->last_op && (probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED));
+    }
+    free(probe);
+    return supported;
+}
+
+int uring_register_files(Uring *ring, unsigned int count) {
+    // A descriptor of -1 leaves its slot empty
+    int *fds = malloc(count * sizeof(*fds));
+    NULL_CHECK(fds, "malloc");
+    for (unsigned int i = 0; i < count; i++) fds[i] = -1;
+    int result = (int)syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, count);
+    free(fds);
+    return (result == -1) ? -1 : 0;
+}
+
+int uring_supports_direct_open(Uring *ring) {
+    // Descriptor 0 is the only one that an open into a slot can be mistaken for, as both complete with 0
+    int stdinOpen = (fcntl(0, F_GETFD) != -1);
+
+    // Open the current directory into the first slot
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    NULL_CHECK(sqe, "uring_get_sqe");
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long)".";
+    sqe->open_flags = O_RDONLY | O_DIRECTORY;
+    sqe->file_index = 1;
+    struct io_uring_cqe cqe;
+    uring_submit(ring, 1);
+    uring_get_cqe(ring, &cqe, 1);
+
+    if (cqe.res < 0) return 0;
+    // A kernel that ignored the slot opened a descriptor instead
+    if (cqe.res > 0 || (!stdinOpen && fcntl(0, F_GETFD) != -1)) {
+        close(cqe.res);
+        return 0;
+    }
+    uring_release_file(ring, 0);
+    return 1;
+}
+
+void uring_release_file(Uring *ring, unsigned int slot) {
+    int fd = -1;
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = (unsigned long)&fd;
+    if (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == -1) {
+        perror("io_uring_register()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void uring_destroy(Uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    if (close(ring->fd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    free(ring);
+}
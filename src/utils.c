@@ -156,6 +156,47 @@ char *get_absolute_path(char *from, char *relative) {
     return result;
 }
 
+// Return the path of the absolute path 'to' in relation to the absolute directory 'from'
+char *relative_path(char *from, char *to) {
+    size_t fromLen = strlen(from);
+    char *relative;
+
+    // Case: 'from' is a prefix of 'to'
+    if (!strncmp(to, from, fromLen)) {
+        relative = malloc((strlen(to) - fromLen + 3) * sizeof(char));
+        NULL_CHECK(relative, "malloc");
+        relative[0] = '.';
+        relative[1] = '/';
+        strcpy(relative + 2, to + fromLen);
+        return relative;
+    }
+
+    // Case: 'from' is deeper than 'to'
+    // Get the offset of the folders that are common in both paths
+    size_t i = 0, offset = 0;
+    int parentsCount = 0;
+    while (from[i] == to[i]) {
+        if (from[i] == '/') offset = i+1;
+        i++;
+    }
+
+    // Count how many folders of 'from' need to be replaced by '..'
+    for (i = offset; i < fromLen; i++) {
+        if (from[i] == '/' && (i == offset || from[i-1] != '/')) parentsCount++;
+    }
+    if (fromLen > offset && from[fromLen-1] != '/') parentsCount++;
+
+    // Build the relative path using '..'
+    size_t len = strlen(to + offset) + 3*parentsCount;
+    relative = malloc((len + 1) * sizeof(char));
+    NULL_CHECK(relative, "malloc");
+    for (i = 0; parentsCount; parentsCount--, i += 3) {
+        memcpy(relative + i, "../", 3);
+    }
+    strcpy(relative + i, to + offset);
+    return relative;
+}
+
 // Paths start with ./ and end with /
 char *fix_path(char *path) {
     char *fixed;
@@ -207,4 +248,14 @@ char *fix_path(char *path) {
         strcat(fixed, "/");
     }
     return fixed;
+}
+
+// Return the 64-bit FNV-1a hash of a given string
+unsigned long hash_string(char *string) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char *c = (unsigned char *)string; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return (unsigned long)hash;
 }
\ No newline at end of file
@@ -0,0 +1,503 @@
+#include <dirent.h>         // DIR etc.
+#include <errno.h>          // errno
+#include <fcntl.h>          // AT_SYMLINK_NOFOLLOW
+#include <poll.h>           // poll()
+#include <signal.h>         // sigprocmask() etc.
+#include <stdio.h>          // perror()
+#include <stdlib.h>         // malloc() etc.
+#include <string.h>         // strcmp() etc.
+#include <sys/inotify.h>    // inotify_init1() etc.
+#include <sys/signalfd.h>   // signalfd()
+#include <sys/stat.h>       // lstat()
+#include <time.h>           // clock_gettime()
+#include <unistd.h>         // read() etc.
+
+#include "arena.h"          // Arena
+#include "cat_manager.h"    // verdicts_init() etc.
+#include "info.h"           // GlobalInfo
+#include "output.h"         // output_added() etc.
+#include "policy.h"         // policy_live_verdict()
+#include "stats.h"          // stats_count()
+#include "utils.h"          // NULL_CHECK() etc.
+#include "watch.h"
+
+// Sides of a path that are differences
+#define FLAG_A 1
+#define FLAG_B 2
+
+// Events of a watched directory that may change the verdict of one of its entries
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO)
+// Events of a directory entry that change the whole subtree below it
+#define SUBTREE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+// Touched paths are gathered until no event arrives for this long, so that a burst of
+// events on the same file is handled once. They are handled anyway after MAX_SETTLE_MSECS
+#define SETTLE_MSECS 50
+#define MAX_SETTLE_MSECS 1000
+// Size of the chunks of the arena that the entries of a round of changes are allocated in
+#define ROUND_CHUNK (64 * 1024)
+
+extern GlobalInfo *info;
+
+// Open addressing with linear probing, keyed on relativeToHier. Removed paths shift the following
+// slots of their probe sequence back, so no tombstones are left behind
+typedef struct {
+    unsigned long hash;
+    char *path;             // relativeToHier of the entry. NULL marks an empty slot
+    char flags;             // Sides of the path that are differences. Uses #defines listed above
+} Slot;
+
+// Paths that are currently differences, in either hierarchy
+typedef struct {
+    Slot *slots;
+    size_t mask;            // Number of slots minus one. The number of slots is a power of 2
+    size_t count;           // Number of used slots
+} Differences;
+
+// Path changed by an event, to be compared again
+typedef struct {
+    char *path;             // relativeToHier of the path
+    int subtree;            // Whether every path below it is compared again too
+} Touch;
+
+static Differences differences;
+static int notifyFd;
+// Position wd refers to the relativeToHier of the directory watched by watch descriptor wd, or NULL
+static char **watched = NULL;
+static int watchedCapacity = 0;
+static Touch *touched = NULL;
+static int touchedCount = 0, touchedCapacity = 0;
+
+static Slot *slots_alloc(size_t capacity) {
+    Slot *slots = malloc(capacity * sizeof(*slots));
+    NULL_CHECK(slots, "malloc");
+    for (size_t i = 0; i < capacity; i++) slots[i].path = NULL;
+    return slots;
+}
+
+// Returns the slot of given path, or the empty slot that ends its probe sequence
+static Slot *slot_find(unsigned long hash, char *path) {
+    size_t s = hash & differences.mask;
+    while (differences.slots[s].path != NULL && (differences.slots[s].hash != hash || strcmp(differences.slots[s].path, path))) {
+        s = (s + 1) & differences.mask;
+    }
+    return &differences.slots[s];
+}
+
+// Returns the sides of given path that are differences
+static char differences_get(char *path) {
+    Slot *slot = slot_find(hash_string(path), path);
+    return (slot->path != NULL) ? slot->flags : 0;
+}
+
+// Empty given slot, and move back the following slots whose probe sequence passes through it
+static void slot_remove(size_t hole) {
+    free(differences.slots[hole].path);
+    differences.slots[hole].path = NULL;
+    differences.count--;
+    for (size_t s = (hole + 1) & differences.mask; differences.slots[s].path != NULL; s = (s + 1) & differences.mask) {
+        size_t home = differences.slots[s].hash & differences.mask;
+        // The slot stays if its home lies cyclically in (hole, s]
+        if (((s - home) & differences.mask) < ((s - hole) & differences.mask)) continue;
+        differences.slots[hole] = differences.slots[s];
+        differences.slots[s].path = NULL;
+        hole = s;
+    }
+}
+
+// Set the sides of given path that are differences. A path with none is removed
+static void differences_set(char *path, char flags) {
+    unsigned long hash = hash_string(path);
+    Slot *slot = slot_find(hash, path);
+    if (slot->path != NULL) {
+        if (flags != 0) slot->flags = flags;
+        else slot_remove(slot - differences.slots);
+        return;
+    }
+    if (flags == 0) return;
+
+    // Keep the load factor at or below 1/2 so that probe sequences stay short
+    if (2 * (differences.count + 1) > differences.mask + 1) {
+        Slot *old = differences.slots;
+        size_t oldCapacity = differences.mask + 1;
+        differences.mask = 2 * oldCapacity - 1;
+        differences.slots = slots_alloc(2 * oldCapacity);
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i].path != NULL) *slot_find(old[i].hash, old[i].path) = old[i];
+        }
+        free(old);
+        slot = slot_find(hash, path);
+    }
+    slot->hash = hash;
+    slot->path = duplicate_string(path);
+    slot->flags = flags;
+    differences.count++;
+}
+
+// Returns true if 'path' is 'root' or lies below it. Every path lies below the root of the hierarchies ("")
+static int in_subtree(char *path, char *root) {
+    size_t len = strlen(root);
+    return len == 0 || (!strncmp(path, root, len) && (path[len] == '\0' || path[len] == '/'));
+}
+
+// Returns the relativeToHier of entry 'name' of the directory whose relativeToHier is 'dir'
+static char *path_join(char *dir, char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    NULL_CHECK(path, "malloc");
+    if (dir[0] == '\0') strcpy(path, name);
+    else sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+// Returns the relativePath of given path of a hierarchy
+static char *path_of(char side, char *path) {
+    char *root = (side == HIER_A) ? info->relativeA : info->relativeB;
+    char *relativePath = malloc(strlen(root) + strlen(path) + 1);
+    NULL_CHECK(relativePath, "malloc");
+    sprintf(relativePath, "%s%s", root, path);
+    return relativePath;
+}
+
+// Watch the directory of a hierarchy whose relativePath is 'relativePath' and its relativeToHier is 'path'
+static void watch_add(char *relativePath, char *path) {
+    int wd = inotify_add_watch(notifyFd, relativePath, WATCH_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+    if (wd == -1) {
+        // The directory may be gone already, in which case its removal is another event
+        if (errno == ENOENT || errno == ENOTDIR) return;
+        perror("inotify_add_watch()");
+        exit(EXIT_FAILURE);
+    }
+    if (wd >= watchedCapacity) {
+        int capacity = (watchedCapacity == 0) ? 64 : watchedCapacity;
+        while (wd >= capacity) capacity *= 2;
+        watched = realloc(watched, capacity * sizeof(*watched));
+        NULL_CHECK(watched, "realloc");
+        for (int i = watchedCapacity; i < capacity; i++) watched[i] = NULL;
+        watchedCapacity = capacity;
+    }
+    // A directory that is watched already keeps its descriptor, but may have moved
+    free(watched[wd]);
+    watched[wd] = duplicate_string(path);
+}
+
+// Stop watching the directories below given path, in both hierarchies. Those still found
+// in the hierarchies are watched again when their subtree is compared again
+static void watch_remove_subtree(char *path) {
+    for (int wd = 0; wd < watchedCapacity; wd++) {
+        if (watched[wd] == NULL || !in_subtree(watched[wd], path)) continue;
+        inotify_rm_watch(notifyFd, wd);
+        free(watched[wd]);
+        watched[wd] = NULL;
+    }
+}
+
+// Remember that given path has to be compared again
+static void touch(char *path, int subtree) {
+    if (touchedCount == touchedCapacity) {
+        touchedCapacity = (touchedCapacity == 0) ? 64 : 2 * touchedCapacity;
+        touched = realloc(touched, touchedCapacity * sizeof(*touched));
+        NULL_CHECK(touched, "realloc");
+    }
+    touched[touchedCount++] = (Touch){path, subtree};
+}
+
+// Returns the entry found in given path of a hierarchy, or NULL if there is none
+static EntryInfo *entry_of(char side, char *path, Arena *arena) {
+    char *relativePath = path_of(side, path);
+    EntryInfo *entry = NULL;
+    struct stat myStat;
+    stats_count(COUNT_LSTAT, 1);
+    if (lstat(relativePath, &myStat) == 0) {
+        // The entry is initialized from its parent directory and its name
+        char *slash = strrchr(relativePath, '/');
+        *slash = '\0';
+        entry = entry_from_stat(&myStat, relativePath, slash + 1, side, arena);
+    }
+    else if (errno != ENOENT && errno != ENOTDIR) {
+        perror("lstat()");
+        exit(EXIT_FAILURE);
+    }
+    free(relativePath);
+    return entry;
+}
+
+// Returns true if given path exists in a hierarchy
+static int exists(char side, char *path) {
+    char *relativePath = path_of(side, path);
+    struct stat myStat;
+    stats_count(COUNT_LSTAT, 1);
+    int found = (lstat(relativePath, &myStat) == 0);
+    free(relativePath);
+    return found;
+}
+
+// Print that given path of a hierarchy stopped being a difference
+static void resolved(char side, char *path) {
+    char *relativePath = path_of(side, path);
+    output_resolved(side, relativePath);
+    free(relativePath);
+}
+
+// Compare given path of both hierarchies again, and print how its verdict changed
+static void compare_again(char *path, Arena *arena) {
+    EntryInfo *entryA = entry_of(HIER_A, path, arena);
+    EntryInfo *entryB = entry_of(HIER_B, path, arena);
+    char flags = 0, verdict = MISSING;
+    if (entryA != NULL && entryB != NULL && (verdict = policy_live_verdict(entryA, entryB)) == VANISHED) {
+        // An entry removed while it was compared is missing, same as one removed before
+        entryA = entry_of(HIER_A, path, arena);
+        entryB = entry_of(HIER_B, path, arena);
+        // Both exist again, so the path was changed since. The event of that change settles it
+        if (entryA != NULL && entryB != NULL) return;
+        verdict = MISSING;
+    }
+    if (entryA != NULL && entryB != NULL) {
+        if (verdict != SAME) flags = FLAG_A | FLAG_B;
+    }
+    else if (entryA != NULL) flags = FLAG_A;
+    else if (entryB != NULL) flags = FLAG_B;
+
+    char old = differences_get(path);
+    if ((old ^ flags) & FLAG_A) {
+        if (flags & FLAG_A) output_added(entryA, entryB, verdict);
+        else resolved(HIER_A, path);
+    }
+    if ((old ^ flags) & FLAG_B) {
+        if (flags & FLAG_B) output_added(entryB, entryA, verdict);
+        else resolved(HIER_B, path);
+    }
+    differences_set(path, flags);
+}
+
+// Compare again every path below given directory of a hierarchy, and watch its subdirectories
+// NOTE: The paths that hierarchyA also has were compared by the walk of hierarchyA
+static void subtree_walk(char side, char *path, Arena *arena) {
+    char *relativePath = path_of(side, path);
+    stats_count(COUNT_OPEN, 1);
+    DIR *dir = opendir(relativePath);
+    if (dir == NULL) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            free(relativePath);
+            return;
+        }
+        perror("opendir()");
+        exit(EXIT_FAILURE);
+    }
+    watch_add(relativePath, path);
+    free(relativePath);
+
+    struct dirent *dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        // Ignore parent and current folder
+        if (!strcmp(dirEntry->d_name, "..") || !strcmp(dirEntry->d_name, ".")) continue;
+        char *child = path_join(path, dirEntry->d_name);
+        if (side == HIER_A || !exists(HIER_A, child)) compare_again(child, arena);
+
+        struct stat myStat;
+        stats_count(COUNT_LSTAT, 1);
+        if (fstatat(dirfd(dir), dirEntry->d_name, &myStat, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(myStat.st_mode)) {
+            subtree_walk(side, child, arena);
+        }
+        free(child);
+    }
+    if (closedir(dir) == -1) {
+        perror("closedir()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Compare again given path and every path below it, in both hierarchies
+static void subtree_again(char *path, Arena *arena) {
+    // Differences below the path that are gone from both hierarchies are not found by the walks
+    int goneCount = 0;
+    char **gone = malloc((differences.count + 1) * sizeof(*gone));
+    NULL_CHECK(gone, "malloc");
+    for (size_t s = 0; s <= differences.mask; s++) {
+        if (differences.slots[s].path != NULL && in_subtree(differences.slots[s].path, path)) {
+            gone[goneCount++] = duplicate_string(differences.slots[s].path);
+        }
+    }
+
+    if (path[0] != '\0') compare_again(path, arena);
+    subtree_walk(HIER_A, path, arena);
+    subtree_walk(HIER_B, path, arena);
+    for (int i = 0; i < goneCount; i++) {
+        if (!exists(HIER_A, gone[i]) && !exists(HIER_B, gone[i])) compare_again(gone[i], arena);
+        free(gone[i]);
+    }
+    free(gone);
+}
+
+// Order touched paths by path
+static int compare_touches(const void *a, const void *b) {
+    return strcmp(((const Touch *)a)->path, ((const Touch *)b)->path);
+}
+
+// Compare again every touched path, once
+static void touched_again(void) {
+    Arena *arena = arena_create(ROUND_CHUNK);
+    qsort(touched, touchedCount, sizeof(*touched), compare_touches);
+    for (int i = 0; i < touchedCount; i++) {
+        // A path touched more than once is compared once, as a subtree if any of its touches was
+        int subtree = touched[i].subtree;
+        while (i + 1 < touchedCount && !strcmp(touched[i].path, touched[i+1].path)) {
+            subtree |= touched[++i].subtree;
+            free(touched[i-1].path);
+        }
+        if (subtree) subtree_again(touched[i].path, arena);
+        else if (touched[i].path[0] != '\0') compare_again(touched[i].path, arena);
+        free(touched[i].path);
+    }
+    touchedCount = 0;
+    arena_destroy(arena);
+    output_flush();
+}
+
+// Read the pending events and touch the paths they changed
+static void events_read(void) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(notifyFd, buffer, sizeof(buffer));
+    if (len == -1) {
+        if (errno == EAGAIN) return;
+        perror("read()");
+        exit(EXIT_FAILURE);
+    }
+
+    for (char *next = buffer; next < buffer + len; ) {
+        struct inotify_event *event = (struct inotify_event *)next;
+        next += sizeof(*event) + event->len;
+
+        // Events were dropped, and nothing tells which directories they were for
+        if (event->mask & IN_Q_OVERFLOW) {
+            touch(duplicate_string(""), 1);
+            continue;
+        }
+        if (event->wd < 0 || event->wd >= watchedCapacity || watched[event->wd] == NULL) continue;
+        // The watch of a removed directory is gone
+        if (event->mask & IN_IGNORED) {
+            free(watched[event->wd]);
+            watched[event->wd] = NULL;
+            continue;
+        }
+
+        // An event without a name is about the watched directory itself
+        if (event->len == 0) {
+            touch(duplicate_string(watched[event->wd]), 0);
+            continue;
+        }
+        char *path = path_join(watched[event->wd], event->name);
+        int subtree = (event->mask & IN_ISDIR) && (event->mask & SUBTREE_EVENTS);
+        // The watches of a directory that moved away point to where it was
+        if ((event->mask & IN_ISDIR) && (event->mask & IN_MOVED_FROM)) watch_remove_subtree(path);
+        touch(path, subtree);
+    }
+}
+
+// Returns the milliseconds of a monotonic clock
+static long long now_msecs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Print the differences of a catalog, whose partners are 'partners', and keep them in the table of differences
+static void differences_init(ArrayWrapper *wrapper, char *verdicts, int *partners, ArrayWrapper *other, char flag) {
+    output_header(wrapper->fromHierarchy);
+    for (int i = 0; i < wrapper->size; i++) {
+        if (verdicts[i] == SAME) continue;
+        EntryInfo entry, partner;
+        wrapper_entry(wrapper, i, &entry);
+        if (partners[i] != -1) wrapper_entry(other, partners[i], &partner);
+        output_difference(&entry, (partners[i] != -1) ? &partner : NULL, verdicts[i]);
+        char *path = wrapper_path(wrapper, i);
+        differences_set(path, differences_get(path) | flag);
+    }
+}
+
+// Watch the root of a hierarchy and every directory of its catalog
+static void watches_init(ArrayWrapper *wrapper) {
+    watch_add((wrapper->fromHierarchy == HIER_A) ? info->relativeA : info->relativeB, "");
+    for (int i = 0; i < wrapper->size; i++) {
+        if (wrapper->types[i] == DIRECTORY) watch_add(wrapper_path(wrapper, i) - wrapper->rootLen, wrapper_path(wrapper, i));
+    }
+}
+
+void watch_run(ArrayWrapper *wrapperA, ArrayWrapper *wrapperB) {
+    differences.mask = 63;
+    differences.count = 0;
+    differences.slots = slots_alloc(differences.mask + 1);
+
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd == -1) {
+        perror("inotify_init1()");
+        exit(EXIT_FAILURE);
+    }
+    // NOTE: The hierarchies were scanned before they were watched, so a change made in between
+    // is only seen along with the next change of its directory
+    watches_init(wrapperA);
+    watches_init(wrapperB);
+
+    VerdictTable *table = verdicts_init(wrapperA, wrapperB);
+    differences_init(wrapperA, table->verdictsA, table->partnersA, wrapperB, FLAG_A);
+    differences_init(wrapperB, table->verdictsB, table->partnersB, wrapperA, FLAG_B);
+    verdicts_destroy(table);
+    output_flush();
+
+    // The signals that end the watch are read from a file descriptor, so that the
+    // watch returns normally, and the signature cache gets written back
+    sigset_t signals, oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, &oldSignals) == -1) {
+        perror("sigprocmask()");
+        exit(EXIT_FAILURE);
+    }
+    int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signalFd == -1) {
+        perror("signalfd()");
+        exit(EXIT_FAILURE);
+    }
+
+    struct pollfd fds[2] = {{.fd = notifyFd, .events = POLLIN}, {.fd = signalFd, .events = POLLIN}};
+    long long firstTouch = 0;
+    while (1) {
+        int ready = poll(fds, 2, (touchedCount > 0) ? SETTLE_MSECS : -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            perror("poll()");
+            exit(EXIT_FAILURE);
+        }
+        if (fds[1].revents & POLLIN) {
+            // The signal is consumed, so that it is not delivered once unblocked
+            struct signalfd_siginfo signal;
+            if (read(signalFd, &signal, sizeof(signal)) == -1) {
+                perror("read()");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int pending = touchedCount;
+            events_read();
+            if (pending == 0 && touchedCount > 0) firstTouch = now_msecs();
+        }
+        // Events settled, or kept arriving for too long
+        if (touchedCount > 0 && (ready == 0 || now_msecs() - firstTouch >= MAX_SETTLE_MSECS)) touched_again();
+    }
+
+    if (close(signalFd) == -1 || close(notifyFd) == -1) {
+        perror("close()");
+        exit(EXIT_FAILURE);
+    }
+    if (sigprocmask(SIG_SETMASK, &oldSignals, NULL) == -1) {
+        perror("sigprocmask()");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < touchedCount; i++) free(touched[i].path);
+    free(touched);
+    for (int wd = 0; wd < watchedCapacity; wd++) free(watched[wd]);
+    free(watched);
+    for (size_t s = 0; s <= differences.mask; s++) free(differences.slots[s].path);
+    free(differences.slots);
+}
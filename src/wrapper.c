@@ -1,35 +1,111 @@
-#include <dirent.h>     // DIR etc
+#include <malloc.h>     // mallopt()
+#include <stdint.h>     // int64_t
 #include <stdio.h>      // perror() etc.
 #include <stdlib.h>     // malloc() etc.
-#include <string.h>     // strcpy() etc.
+#include <string.h>     // memcpy() etc.
+#include <sys/mman.h>   // munmap()
 
+#include "arena.h"      // Arena
 #include "info.h"       // GlobalInfo
+#include "manifest.h"   // manifest_load()
+#include "pool.h"       // ThreadPool
+#include "scanner.h"    // DirScan etc.
+#include "sigcache.h"   // cache_lookup()
 #include "utils.h"      // NULL_CHECK() etc.
 #include "wrapper.h"
 
+// Size of the chunks that the arenas of the entries reserve
+#define ARENA_CHUNK (1024 * 1024)
+
 extern GlobalInfo *info;
 
-// Initialize an array of EntryInfo pointers
-static void array_init(char *path, ArrayWrapper *wp) {
-    DIR *dir;
-    struct dirent *entry;
+// Allocate every column with room for 'size' entries
+// NOTE: One extra position is allocated, so that an empty hierarchy still gets valid columns
+static void columns_alloc(ArrayWrapper *wp, int size) {
+    wp->index = 0;
+    wp->size = size;
+    wp->types = malloc((size + 1) * sizeof(*wp->types));
+    NULL_CHECK(wp->types, "malloc");
+    wp->sizes = malloc((size + 1) * sizeof(*wp->sizes));
+    NULL_CHECK(wp->sizes, "malloc");
+    wp->mtimes = malloc((size + 1) * sizeof(*wp->mtimes));
+    NULL_CHECK(wp->mtimes, "malloc");
+    wp->mtimeNsecs = malloc((size + 1) * sizeof(*wp->mtimeNsecs));
+    NULL_CHECK(wp->mtimeNsecs, "malloc");
+    wp->devices = malloc((size + 1) * sizeof(*wp->devices));
+    NULL_CHECK(wp->devices, "malloc");
+    wp->inodes = malloc((size + 1) * sizeof(*wp->inodes));
+    NULL_CHECK(wp->inodes, "malloc");
+    wp->links = malloc((size + 1) * sizeof(*wp->links));
+    NULL_CHECK(wp->links, "malloc");
+    wp->perms = malloc((size + 1) * sizeof(*wp->perms));
+    NULL_CHECK(wp->perms, "malloc");
+    wp->hashes = malloc((size + 1) * sizeof(*wp->hashes));
+    NULL_CHECK(wp->hashes, "malloc");
+    wp->paths = malloc((size + 1) * sizeof(*wp->paths));
+    NULL_CHECK(wp->paths, "malloc");
+    wp->names = malloc((size + 1) * sizeof(*wp->names));
+    NULL_CHECK(wp->names, "malloc");
+    wp->parents = malloc((size + 1) * sizeof(*wp->parents));
+    NULL_CHECK(wp->parents, "malloc");
+}
+
+// Count the entries below a scanned directory and the bytes their relative paths take
+static void scan_totals(DirScan *dir, int *count, size_t *bytes) {
+    *count += dir->count;
+    for (int i = 0; i < dir->count; i++) *bytes += strlen(dir->entries[i]->relativePath) + 1;
+    for (int i = 0; i < dir->subdirCount; i++) scan_totals(dir->subdirs[i], count, bytes);
+}
+
+// Append an entry of the directory in position 'parent' to the columns. Its relativePath is copied to the string pool
+// NOTE: The columns and the string pool must already have room for it
+static void columns_append(ArrayWrapper *wp, EntryInfo *entry, int parent) {
+    size_t len = strlen(entry->relativePath) + 1;
+    memcpy(wp->strings + wp->stringsLen, entry->relativePath, len);
+
+    int i = wp->index++;
+    wp->types[i] = entry->fileType;
+    wp->sizes[i] = entry->size;
+    wp->mtimes[i] = entry->mtime;
+    wp->mtimeNsecs[i] = entry->mtimeNsec;
+    wp->devices[i] = entry->device;
+    wp->inodes[i] = entry->inode;
+    wp->links[i] = entry->links;
+    wp->perms[i] = entry->perms;
+    wp->hashes[i] = hash_string(entry->relativeToHier);
+    wp->paths[i] = wp->stringsLen + wp->rootLen;
+    wp->names[i] = entry->name - entry->relativeToHier;
+    wp->parents[i] = parent;
+    wp->stringsLen += len;
+}
 
-    // GOAL: Store hierarchy's entries per level in the array, 
+// Initialize the columns from the scan of a hierarchy
+static void columns_init(DirScan *root, ArrayWrapper *wp) {
+    // GOAL: Store hierarchy's entries per level in the columns, 
     // so as to ease and optimize the traversals of it later
+    // NOTE: Directories are scanned in parallel and in no particular order, so the
+    // levels are laid out here, once every directory has been scanned. The resulting
+    // order only depends on the order in which each directory listed its entries
 
-    // Dynamic 1D-string-array buffer that stores the directories of the current level
+    // Dynamic 1D-array buffer that stores the scanned directories of the current level
     int currCapacity = 64;
-    char **currDirs = malloc(currCapacity * sizeof(*currDirs));
+    DirScan **currDirs = malloc(currCapacity * sizeof(*currDirs));
     NULL_CHECK(currDirs, "malloc");
+    // Position of the entry of every above directory in the columns
+    int *currParents = malloc(currCapacity * sizeof(*currParents));
+    NULL_CHECK(currParents, "malloc");
     int currIndex = 0;
-    // Dynamic 1D-string-array buffer that stores the directories of the next (new) level
+    // Dynamic 1D-array buffer that stores the scanned directories of the next (new) level
     int newCapacity = 64;
-    char **newDirs = malloc(newCapacity * sizeof(*newDirs));
+    DirScan **newDirs = malloc(newCapacity * sizeof(*newDirs));
     NULL_CHECK(newDirs, "malloc");
+    int *newParents = malloc(newCapacity * sizeof(*newParents));
+    NULL_CHECK(newParents, "malloc");
     int newIndex = 0;
 
-    // At first, the only current directory is the one given
-    currDirs[currIndex] = path;
+    // At first, the only current directory is the one given, which has no entry
+    currDirs[currIndex] = root;
+    currParents[currIndex] = -1;
     currIndex++;
 
     int levelsCounter = 0;
@@ -41,50 +117,28 @@ static void array_init(char *path, ArrayWrapper *wp) {
             wp->levels = realloc(wp->levels, wp->lastLevel * sizeof(*wp->levels));
             NULL_CHECK(wp->levels, "realloc");
         }
-        wp->levels[levelsCounter] = wp->index; // Index of where each level starts in the array
+        wp->levels[levelsCounter] = wp->index; // Index of where each level starts in the columns
         levelsCounter++;
 
         // For every directory of current level
         while (currIndex--) {
-            if ((dir = opendir(currDirs[currIndex])) == NULL) {
-                perror("opendir()");
-                exit(EXIT_FAILURE);
-            }
+            DirScan *dir = currDirs[currIndex];
 
-            // For every entry of current directory of current level
-            while ((entry = readdir(dir)) != NULL) {
-                // Ignore parent and current folder
-                if (!strcmp(entry->d_name, "..") || !strcmp(entry->d_name, ".")) continue;
-
-                // Get relative path
-                char *relative = concatinate(currDirs[currIndex], entry->d_name);
-
-                // Initialize an entry inside the array
-                if (wp->index == wp->size) {
-                    wp->size *= 2;
-                    wp->array = realloc(wp->array, wp->size * sizeof(EntryInfo *));
-                    NULL_CHECK(wp->array, "realloc");
-                }
-                // NULL is only returned when faced with a symlink that points outside its hierarchy
-                if ((wp->array[wp->index] = entry_init(relative, entry->d_name, wp->fromHierarchy)) != NULL) {
-                    if (wp->array[wp->index]->fileType == DIRECTORY) {
-                        // Mark subdirectory to expand/traverse in the next level
-                        if (newIndex == newCapacity) {
-                            newCapacity *= 2;
-                            newDirs = realloc(newDirs, newCapacity * sizeof(*newDirs));
-                            NULL_CHECK(newDirs, "realloc");
-                        }
-                        newDirs[newIndex] = wp->array[wp->index]->relativePath;
-                        newIndex++;
-                    }
-                    wp->index++;
-                }
-                free(relative);
+            // Mark subdirectories to expand/traverse in the next level
+            if (newIndex + dir->subdirCount > newCapacity) {
+                do { newCapacity *= 2; } while (newIndex + dir->subdirCount > newCapacity);
+                newDirs = realloc(newDirs, newCapacity * sizeof(*newDirs));
+                NULL_CHECK(newDirs, "realloc");
+                newParents = realloc(newParents, newCapacity * sizeof(*newParents));
+                NULL_CHECK(newParents, "realloc");
             }
+            memcpy(newDirs + newIndex, dir->subdirs, dir->subdirCount * sizeof(*dir->subdirs));
 
-            if (closedir(dir) == -1) {
-                perror("closedir()");
-                exit(EXIT_FAILURE);
+            // Append the entries of current directory to the columns. The scans of the
+            // subdirectories are in the same order as their entries
+            for (int i = 0; i < dir->count; i++) {
+                if (dir->entries[i]->fileType == DIRECTORY) newParents[newIndex++] = wp->index;
+                columns_append(wp, dir->entries[i], currParents[currIndex]);
             }
         }
 
@@ -97,9 +151,12 @@ static void array_init(char *path, ArrayWrapper *wp) {
             do { currCapacity *= 2; } while (currCapacity < newIndex);
             currDirs = realloc(currDirs, currCapacity * sizeof(*currDirs));
             NULL_CHECK(currDirs, "realloc");
+            currParents = realloc(currParents, currCapacity * sizeof(*currParents));
+            NULL_CHECK(currParents, "realloc");
         }
         // For the new level, currDirs is the previous's level newDirs
         memcpy(currDirs, newDirs, newIndex * sizeof(*newDirs));
+        memcpy(currParents, newParents, newIndex * sizeof(*newParents));
         currIndex = newIndex;
 
         // Reset newDirs
@@ -113,38 +170,245 @@ static void array_init(char *path, ArrayWrapper *wp) {
 
     free(currDirs);
     free(newDirs);
+    free(currParents);
+    free(newParents);
 }
 
-// Initialize a wrapper
-ArrayWrapper *wrapper_init(char *path, char fromHierarchy) {
+// Initialize a wrapper from the scan of its hierarchy. Nothing of the wrapper points inside the scan
+static ArrayWrapper *wrapper_init(DirScan *root, char fromHierarchy) {
     ArrayWrapper *wrapper = malloc(sizeof(*wrapper));
     NULL_CHECK(wrapper, "malloc");
 
     wrapper->fromHierarchy = fromHierarchy;
+    wrapper->directoryStats = scanner_stats_directories(fromHierarchy);
+    wrapper->rootLen = (fromHierarchy == HIER_A) ? info->lenRelA : info->lenRelB;
+    wrapper->digests = NULL;
+    wrapper->digestsKnown = NULL;
+    wrapper->map = NULL;
+    wrapper->mapLen = 0;
 
     wrapper->levels = malloc(8 * sizeof(*wrapper->levels));
     NULL_CHECK(wrapper->levels, "malloc");
     wrapper->lastLevel = 7;
 
-    // Wrapper is initially empty with a temporary max size of 8
-    // If the size of the array is exceeded, it then gets doubled
-    wrapper->index = 0;
-    wrapper->size = 8;
-    wrapper->array = malloc(wrapper->size * sizeof(EntryInfo *));
-    NULL_CHECK(wrapper->array, "malloc");
-    array_init(path, wrapper);
-    // After inserting all entries, get the array's max size
-    wrapper->size = wrapper->index;
+    // The columns and the string pool are allocated at their final size, so they
+    // are never reallocated, and never take more memory than they need
+    int count = 0;
+    size_t bytes = 0;
+    scan_totals(root, &count, &bytes);
+    columns_alloc(wrapper, count);
+    wrapper->stringsLen = 0;
+    wrapper->strings = malloc(bytes + 1);
+    NULL_CHECK(wrapper->strings, "malloc");
+    columns_init(root, wrapper);
+
+    // Index every level by relativeToHier, so that entries can be matched
+    // against the other hierarchy in expected constant time
+    wrapper->indexes = malloc((wrapper->lastLevel + 1) * sizeof(*wrapper->indexes));
+    NULL_CHECK(wrapper->indexes, "malloc");
+    for (int level = 0; level <= wrapper->lastLevel; level++) {
+        wrapper->indexes[level] = hash_index_create(wrapper->hashes, wrapper->strings, wrapper->paths,
+                                                    wrapper->levels[level], wrapper->levels[level+1]);
+    }
 
     return wrapper;
 }
 
+// Name and position of an entry, so that the entries of a directory can be sorted by name
+typedef struct {
+    char *name;
+    int position;
+} Child;
+
+// Order children by name
+static int compare_children(const void *a, const void *b) {
+    return strcmp(((const Child *)a)->name, ((const Child *)b)->name);
+}
+
+// Fill the signatures of the files from the signature cache, and build the digests of the directories
+// bottom-up, from the last level to the first one. The entries of a directory are next to each other
+// in their level, and are hashed in the order of their names, so the digest does not depend on the
+// order in which the directory listed them
+static void digests_init(ArrayWrapper *wrapper) {
+    wrapper->digests = malloc((wrapper->size + 1) * sizeof(*wrapper->digests));
+    NULL_CHECK(wrapper->digests, "malloc");
+    wrapper->digestsKnown = malloc((wrapper->size + 1) * sizeof(*wrapper->digestsKnown));
+    NULL_CHECK(wrapper->digestsKnown, "malloc");
+
+    // Digest of a directory without entries
+    Sha256 sha;
+    unsigned char empty[SHA256_LEN];
+    sha256_init(&sha);
+    sha256_final(&sha, empty);
+    for (int i = 0; i < wrapper->size; i++) {
+        // A directory is known until one of its entries is not
+        if (wrapper->types[i] == DIRECTORY) {
+            memcpy(wrapper->digests[i], empty, SHA256_LEN);
+            wrapper->digestsKnown[i] = 1;
+        }
+        // Symlinks are compared by the files they point to, which no signature describes
+        else if (wrapper->types[i] == SYMLINK) wrapper->digestsKnown[i] = 0;
+        // Empty files have no contents to sign
+        else if (wrapper->sizes[i] == 0) {
+            memset(wrapper->digests[i], 0, SHA256_LEN);
+            wrapper->digestsKnown[i] = 1;
+        }
+        else {
+            EntryInfo entry;
+            wrapper_entry(wrapper, i, &entry);
+            wrapper->digestsKnown[i] = cache_lookup(info->cache, &entry, wrapper->digests[i]);
+        }
+    }
+
+    Child *children = malloc((wrapper->size + 1) * sizeof(*children));
+    NULL_CHECK(children, "malloc");
+    for (int level = wrapper->lastLevel; level >= 0; level--) {
+        int end = wrapper->levels[level+1];
+        for (int start = wrapper->levels[level], next; start < end; start = next) {
+            int parent = wrapper->parents[start];
+            int count = 0, known = 1;
+            for (next = start; next < end && wrapper->parents[next] == parent; next++) {
+                known &= wrapper->digestsKnown[next];
+                children[count++] = (Child){wrapper_path(wrapper, next) + wrapper->names[next], next};
+            }
+            // The entries of the root have no directory entry to describe
+            if (parent == -1) continue;
+            if (!known) {
+                wrapper->digestsKnown[parent] = 0;
+                continue;
+            }
+
+            qsort(children, count, sizeof(*children), compare_children);
+            sha256_init(&sha);
+            for (int k = 0; k < count; k++) {
+                int i = children[k].position;
+                // The size of a directory depends on its filesystem, not on its entries
+                int64_t size = (wrapper->types[i] == DIRECTORY) ? 0 : wrapper->sizes[i];
+                sha256_update(&sha, &wrapper->types[i], 1);
+                sha256_update(&sha, &size, sizeof(size));
+                sha256_update(&sha, children[k].name, strlen(children[k].name) + 1);
+                sha256_update(&sha, wrapper->digests[i], SHA256_LEN);
+            }
+            sha256_final(&sha, wrapper->digests[parent]);
+        }
+    }
+    free(children);
+}
+
+// Destroy the arenas of the workers
+static void arenas_destroy(Arena **arenas, int count) {
+    for (int i = 0; i < count; i++) {
+        arena_destroy(arenas[i]);
+    }
+    free(arenas);
+}
+
+// Initialize the wrappers of both hierarchies
+void wrappers_init(char *pathA, char *pathB, ArrayWrapper **wrapperA, ArrayWrapper **wrapperB) {
+    // Every worker allocates the entries it scans in an arena of its own for each hierarchy,
+    // so scanning needs no locks and makes only a few large allocations
+    int threads = info->options.threads;
+    // NOTE: Fix the size over which malloc() maps blocks on its own. Otherwise, freeing the
+    // scratch space of the scan raises it, and the columns of the wrappers that get allocated
+    // right after end up on the heap next to the freed space, which raises the peak memory usage
+    mallopt(M_MMAP_THRESHOLD, ARENA_CHUNK);
+    Arena **arenasA = malloc(threads * sizeof(*arenasA));
+    NULL_CHECK(arenasA, "malloc");
+    Arena **arenasB = malloc(threads * sizeof(*arenasB));
+    NULL_CHECK(arenasB, "malloc");
+    for (int i = 0; i < threads; i++) {
+        arenasA[i] = arena_create(ARENA_CHUNK);
+        arenasB[i] = arena_create(ARENA_CHUNK);
+    }
+
+    // Both hierarchies are scanned at the same time, by the same pool of threads. A hierarchy
+    // with a manifest is not scanned at all
+    char *manifestA = info->options.manifestA, *manifestB = info->options.manifestB;
+    ThreadPool *pool = pool_create(threads);
+    scanner_init(threads);
+    DirScan *rootA = (manifestA == NULL) ? scan_directory(pool, arenasA, pathA, HIER_A) : NULL;
+    DirScan *rootB = (manifestB == NULL) ? scan_directory(pool, arenasB, pathB, HIER_B) : NULL;
+    pool_wait(pool);
+    pool_destroy(pool);
+    scanner_destroy();
+
+    // The entries of the scan are copied to the columns of the wrappers, so the arenas are
+    // only scratch space. Release each hierarchy's arenas as soon as its wrapper is built
+    if (rootA != NULL) {
+        *wrapperA = wrapper_init(rootA, HIER_A);
+        scan_destroy(rootA);
+    }
+    else *wrapperA = manifest_load(manifestA, HIER_A);
+    arenas_destroy(arenasA, threads);
+    if (rootB != NULL) {
+        *wrapperB = wrapper_init(rootB, HIER_B);
+        scan_destroy(rootB);
+    }
+    else *wrapperB = manifest_load(manifestB, HIER_B);
+    arenas_destroy(arenasB, threads);
+
+    // The digests of the directories are built from the signatures of the cache, unless a manifest holds them
+    if (info->cache != NULL && (*wrapperA)->digests == NULL) digests_init(*wrapperA);
+    if (info->cache != NULL && (*wrapperB)->digests == NULL) digests_init(*wrapperB);
+}
+
+// Fill 'entry' with the fields of the entry in position i
+void wrapper_entry(ArrayWrapper *wrapper, int i, EntryInfo *entry) {
+    entry->relativeToHier = wrapper->strings + wrapper->paths[i];
+    entry->relativePath = entry->relativeToHier - wrapper->rootLen;
+    entry->name = entry->relativeToHier + wrapper->names[i];
+    entry->device = wrapper->devices[i];
+    entry->inode = wrapper->inodes[i];
+    entry->links = wrapper->links[i];
+    entry->size = wrapper->sizes[i];
+    entry->mtime = wrapper->mtimes[i];
+    entry->mtimeNsec = wrapper->mtimeNsecs[i];
+    entry->perms = wrapper->perms[i];
+    entry->fileType = wrapper->types[i];
+    entry->fromHierarchy = wrapper->fromHierarchy;
+}
+
+// Returns the relativeToHier of the entry in position i
+char *wrapper_path(ArrayWrapper *wrapper, int i) {
+    return wrapper->strings + wrapper->paths[i];
+}
+
+unsigned char *wrapper_digest(ArrayWrapper *wrapper, int i) {
+    return (wrapper->digests != NULL && wrapper->digestsKnown[i]) ? wrapper->digests[i] : NULL;
+}
+
+// Free a column, unless it lies in the mapping of a manifest
+static void column_free(ArrayWrapper *wrapper, void *column) {
+    char *map = wrapper->map;
+    if (map != NULL && (char *)column >= map && (char *)column <= map + wrapper->mapLen) return;
+    free(column);
+}
+
 // Destroy a wrapper using appropriate memory deallocation
 void wrapper_destroy(ArrayWrapper *wrapper) {
-    for (int i = 0; i < wrapper->size; i++) {
-        entry_destroy(wrapper->array[i]);
+    for (int level = 0; level <= wrapper->lastLevel; level++) {
+        hash_index_destroy(wrapper->indexes[level]);
+    }
+    free(wrapper->indexes);
+    column_free(wrapper, wrapper->types);
+    column_free(wrapper, wrapper->sizes);
+    column_free(wrapper, wrapper->mtimes);
+    column_free(wrapper, wrapper->mtimeNsecs);
+    column_free(wrapper, wrapper->devices);
+    column_free(wrapper, wrapper->inodes);
+    column_free(wrapper, wrapper->links);
+    column_free(wrapper, wrapper->perms);
+    column_free(wrapper, wrapper->hashes);
+    column_free(wrapper, wrapper->paths);
+    column_free(wrapper, wrapper->names);
+    column_free(wrapper, wrapper->parents);
+    column_free(wrapper, wrapper->strings);
+    column_free(wrapper, wrapper->levels);
+    column_free(wrapper, wrapper->digests);
+    column_free(wrapper, wrapper->digestsKnown);
+    if (wrapper->map != NULL && munmap(wrapper->map, wrapper->mapLen) == -1) {
+        perror("munmap()");
+        exit(EXIT_FAILURE);
     }
-    free(wrapper->array);
-    free(wrapper->levels);
     free(wrapper);
 }